@@ -36,7 +36,6 @@ kMeans::kMeans(int k, std::vector<std::shared_ptr<ImageVector>> points, Metric*
     double minDistance, minDistanceSquared, randomDistance, maxDistance;
     double sumOfSquaredDistances;
 
-    std::shared_ptr<ImageVector> centroid;
     std::shared_ptr<Cluster> cluster;
 
     std::priority_queue<double, std::vector<double>, std::greater<double>> distancesFromCentroids;
@@ -74,26 +73,25 @@ kMeans::kMeans(int k, std::vector<std::shared_ptr<ImageVector>> points, Metric*
     printf("Assigning Centroids... ");
     fflush(stdout);
 
+    // The distance of every point to its closest centroid so far. Only the newest centroid can make it any
+    // smaller, so every round scores all the points against that one in a single batch
+    std::shared_ptr<DatasetStore> store = get_point_store();
+    std::vector<double> nearestCentroidDistances((this->Points).size(), DBL_MAX);
+    std::vector<double> newCentroidDistances((this->Points).size());
+
     // Assign the rest of the centroids
     while ((int)(this->Clusters).size() < K){
         sumOfSquaredDistances = 0;  // Reset the sum of squared distances
         minDistances.clear();       // Reset the vector of minimum distances
         minDistances.push_back(std::make_pair(0.0, 0));  // Initialize the first element of the vector
 
-        for (i = 0; i < (int)(this->Points).size(); i++){
-            minDistance = std::numeric_limits<double>::max();  // Start with a large value
+        StoreQuery newCentroid = store->make_query(this->Clusters.back()->get_centroid());
+        std::vector<const StoreQuery*> queries(1, &newCentroid);
+        store->comparison_distances(queries, 0, store->size(), Kmetric, newCentroidDistances.data());
 
-            centroid = this->Clusters[0]->get_centroid();  // Assume first centroid is the closest
-            double distance = Kmetric->calculate_distance((this->Points)[i]->get_coordinates(), centroid->get_coordinates());
-            
-            // Find the closest centroid
-            for (j = 1; j < (int)(this->Clusters).size(); j++){
-                centroid = this->Clusters[j]->get_centroid();
-                double tempDistance = Kmetric->calculate_distance((this->Points)[i]->get_coordinates(), centroid->get_coordinates());
-                if (tempDistance < distance){
-                    distance = tempDistance;
-                }
-            }
+        for (i = 0; i < (int)(this->Points).size(); i++){
+            nearestCentroidDistances[i] = std::min(nearestCentroidDistances[i], newCentroidDistances[i]);
+            double distance = Kmetric->to_distance(nearestCentroidDistances[i]);
 
             minDistance = distance / maxDistance;  // Normalize
             // minDistance = distance;  // Dont  Normalize
@@ -125,7 +123,7 @@ std::shared_ptr<Cluster> kMeans::get_nearest_cluster(std::shared_ptr<ImageVector
 
     for(j = 0; j < (int)(this->Clusters).size(); j++){
         tempCentroid = (this->Clusters)[j]->get_centroid();
-        distance = Kmetric->calculate_distance(point->get_coordinates(), tempCentroid->get_coordinates()); // Calculate the distance from each centroid
+        distance = Kmetric->comparison_distance(point->get_coordinates(), tempCentroid->get_coordinates()); // Calculate the distance from each centroid, only the order matters
         if(distance < minDinstace){
             minDinstace = distance; // Get the minimum distance
             nearestCluster = (this->Clusters)[j]; // Get the nearest cluster
@@ -144,11 +142,52 @@ std::vector<std::shared_ptr<Cluster>>& kMeans::get_clusters(){
     return this->Clusters;
 }
 
+std::shared_ptr<DatasetStore> kMeans::get_point_store(){
+    if(this->PointStore == nullptr){
+        this->PointStore = std::make_shared<DatasetStore>(this->Points, STORE_UINT8); // Falls back to floats by itself if they are not pixels
+    }
+    return this->PointStore;
+}
+
+void kMeans::nearest_centroids(std::vector<int>& nearest){
+    int i, j, block, blockSize;
+    int numberOfClusters = (int)(this->Clusters).size();
+    double minDinstace;
+    std::shared_ptr<DatasetStore> store = get_point_store();
+
+    // The centroids don't move during the assignment, so they are one tile of queries against every block of points
+    std::vector<StoreQuery> centroidQueries;
+    std::vector<const StoreQuery*> queries;
+    centroidQueries.reserve(numberOfClusters);
+    for(j = 0; j < numberOfClusters; j++){
+        centroidQueries.push_back(store->make_query((this->Clusters)[j]->get_centroid()));
+    }
+    for(j = 0; j < numberOfClusters; j++) queries.push_back(&centroidQueries[j]);
+
+    nearest.assign(store->size(), 0);
+    std::vector<double> distances((size_t)numberOfClusters * ASSIGNMENT_BLOCK);
+    for(block = 0; block < store->size(); block += ASSIGNMENT_BLOCK){
+        blockSize = std::min(ASSIGNMENT_BLOCK, store->size() - block);
+        store->comparison_distances(queries, block, blockSize, Kmetric, distances.data());
+        for(i = 0; i < blockSize; i++){
+            minDinstace = DBL_MAX;
+            for(j = 0; j < numberOfClusters; j++){
+                if(distances[(size_t)j * blockSize + i] < minDinstace){ // Ties go to the first cluster, same as get_nearest_cluster
+                    minDinstace = distances[(size_t)j * blockSize + i];
+                    nearest[block + i] = j;
+                }
+            }
+        }
+    }
+}
+
 void kMeans::lloyds_assigment(){ // Lloyds-type assignment
     int i;
     std::shared_ptr<Cluster> nearestCluster;
+    std::vector<int> nearest;
+    nearest_centroids(nearest);
     for(i = 0; i < (int)(this->Points).size(); i++){
-        nearestCluster = get_nearest_cluster((this->Points)[i]); // Get the nearest centroid to the point
+        nearestCluster = (this->Clusters)[nearest[i]]; // Get the nearest centroid to the point
         nearestCluster->add_point((this->Points)[i]); // Add the point to the cluster
         // printf("Cluster with centroid id: %d has %d points\n",(nearestCluster->get_centroid())->get_number(), (int)nearestCluster->get_points().size());
     }
@@ -436,7 +475,7 @@ std::shared_ptr<Cluster> kMeans::get_nearest_cluster_excluding_the_assigned_one(
     for(j = 0; j < (int)(this->Clusters).size(); j++){
         if(alreadyAssignedClusterCentroid == (this->Clusters)[j]->get_centroid()) continue; // If the cluster is the one that the point is already assigned to, skip it
         tempCentroid = (this->Clusters)[j]->get_centroid();
-        distance = Kmetric->calculate_distance(point->get_coordinates(), tempCentroid->get_coordinates()); // Calculate the distance from each centroid
+        distance = Kmetric->comparison_distance(point->get_coordinates(), tempCentroid->get_coordinates()); // Calculate the distance from each centroid, only the order matters
         if(distance < minDistance){
             minDistance = distance; // Get the minimum distance
             nearestCluster = (this->Clusters)[j]; // Get the nearest cluster
@@ -514,12 +553,12 @@ double kMeans::get_distance_to_nearest_cluster(std::shared_ptr<ImageVector> poin
     double minDinstace = DBL_MAX;
 
     for(auto& cluster : this->Clusters){
-        distance = Kmetric->calculate_distance(point->get_coordinates(), cluster->get_centroid()->get_coordinates()); // Calculate the distance from each centroid
+        distance = Kmetric->comparison_distance(point->get_coordinates(), cluster->get_centroid()->get_coordinates()); // Calculate the distance from each centroid
         if(distance < minDinstace){
             minDinstace = distance; // Get the minimum distance
         }
     }
-    return minDinstace;
+    return Kmetric->to_distance(minDinstace);
 }
 
 double kMeans::get_objective_function_value(){
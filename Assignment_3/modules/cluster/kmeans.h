@@ -18,12 +18,14 @@
 #include "metrics.h"
 #include "approximate_methods.h"
 #include "cluster.h"
+#include "dataset_store.h"
 
 #define NUMBER_OF_CLUSTERS_CONVERGENCE_PERCENTAGE_TOLERANCE 0.8 // If at 100% of the clusters are converged then we have converged
 #define DISTANCE_DIFFERENCE_AS_MAX_PERCENTAGE_TOLERANCE 0.01 // If the change in the distance is less than 1% of the max distance between two points in our dataset then we have converged
 #define CHANGE_OF_DISTANCE_DIFFERENCE_PERCENTAGE_TOLERANCE 0.95 // Taking into account the percentage of the change of the change of distance between two epochs
 #define OSCILATION_TOLERANCE 0.005
 #define LEAST_NUMBER_OF_EPOCHS 5
+#define ASSIGNMENT_BLOCK 1024 // Points that get scored against all the centroids at once
 
 double round_up_to_nearest_order_of_magnitude(double number);
 
@@ -39,6 +41,10 @@ class kMeans{
     double MaxDist;
     Metric* Kmetric;
 
+    std::shared_ptr<DatasetStore> PointStore; // The points as rows, same order as Points, for the batched distances
+    std::shared_ptr<DatasetStore> get_point_store();
+    void nearest_centroids(std::vector<int>& nearest); // For every point the index of its nearest cluster, like get_nearest_cluster
+
     public:
     kMeans(std::vector<std::shared_ptr<Cluster>> Clusters, std::map<std::shared_ptr<ImageVector>, std::shared_ptr<Cluster>> PointToClusterMap, Metric* metric);
     kMeans(int k, std::vector<std::shared_ptr<ImageVector>> points, Metric* metric);
@@ -0,0 +1,394 @@
+#include "dataset_store.h"
+#include "distance_kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <new>
+#include <algorithm>
+
+static bool is_byte(double value){
+    return value >= 0.0 && value <= 255.0 && value == std::floor(value);
+}
+
+void DatasetStore::allocate(int numberOfRows, int dimensions){
+    void* memory = nullptr;
+    int padding = (this->Type == STORE_UINT8) ? STORE_BYTE_ROW_PADDING : STORE_ROW_PADDING;
+    size_t elementSize = (this->Type == STORE_UINT8) ? sizeof(unsigned char) : sizeof(float);
+
+    this->NumberOfRows = numberOfRows;
+    this->Dimensions = dimensions;
+    this->Stride = ((dimensions + padding - 1) / padding) * padding;
+
+    size_t bytes = (size_t)this->NumberOfRows * this->Stride * elementSize;
+    if(posix_memalign(&memory, STORE_ALIGNMENT, bytes > 0 ? bytes : STORE_ALIGNMENT) != 0){
+        throw std::bad_alloc();
+    }
+    memset(memory, 0, bytes); // The padding has to be zero so that it adds nothing to the distances
+
+    this->Rows = nullptr;
+    this->ByteRows = nullptr;
+    if(this->Type == STORE_UINT8) this->ByteRows = static_cast<unsigned char*>(memory);
+    else this->Rows = static_cast<float*>(memory);
+
+    this->Images.resize(this->NumberOfRows);
+}
+
+DatasetStore::DatasetStore(const std::vector<std::shared_ptr<ImageVector>>& images, StorageType type){
+    int row, i;
+    bool consecutive = true;
+
+    // Bytes only make sense if every coordinate is one, otherwise keep the floats
+    this->Type = type;
+    if(this->Type == STORE_UINT8){
+        for(row = 0; row < (int)images.size() && this->Type == STORE_UINT8; row++){
+            for(auto& coordinate : images[row]->get_coordinates()){
+                if(!is_byte(coordinate)){
+                    printf("The coordinates do not fit in a byte, storing them as floats instead\n");
+                    this->Type = STORE_FLOAT32;
+                    break;
+                }
+            }
+        }
+    }
+
+    allocate((int)images.size(), images.empty() ? 0 : (int)images[0]->get_coordinates().size());
+
+    this->FirstNumber = images.empty() ? 0 : images[0]->get_number();
+    for(row = 0; row < this->NumberOfRows; row++){
+        const std::vector<double>& coordinates = images[row]->get_coordinates();
+        int size = (this->Dimensions < (int)coordinates.size()) ? this->Dimensions : (int)coordinates.size();
+        if(this->Type == STORE_UINT8){
+            unsigned char* destination = this->ByteRows + (size_t)row * this->Stride;
+            for(i = 0; i < size; i++) destination[i] = (unsigned char)coordinates[i];
+        }
+        else{
+            float* destination = this->Rows + (size_t)row * this->Stride;
+            for(i = 0; i < size; i++) destination[i] = (float)coordinates[i];
+        }
+        this->Images[row] = images[row]; // Keep the same pointers so the results compare equal to the caller's images
+        if(images[row]->get_number() != this->FirstNumber + row) consecutive = false;
+    }
+
+    if(!consecutive){
+        this->Numbers.resize(this->NumberOfRows);
+        for(row = 0; row < this->NumberOfRows; row++){
+            this->Numbers[row] = images[row]->get_number();
+            this->NumberToRow[this->Numbers[row]] = row;
+        }
+    }
+    compute_row_norms();
+}
+
+DatasetStore::DatasetStore(MappedImages& mapped, int imagesAlreadyRead, StorageType type){
+    int row, i;
+
+    this->Type = type;
+    allocate(mapped.get_number_of_images(), mapped.get_number_of_pixels());
+    this->FirstNumber = imagesAlreadyRead + 1;
+
+    for(row = 0; row < this->NumberOfRows; row++){
+        const unsigned char* pixels = mapped.get_image(row);
+        if(this->Type == STORE_UINT8){
+            memcpy(this->ByteRows + (size_t)row * this->Stride, pixels, this->Dimensions);
+        }
+        else{
+            float* destination = this->Rows + (size_t)row * this->Stride;
+            for(i = 0; i < this->Dimensions; i++){
+                destination[i] = (float)pixels[i];
+            }
+        }
+    }
+    compute_row_norms();
+}
+
+void DatasetStore::compute_row_norms(){
+    this->RowNorms.resize(this->NumberOfRows);
+    for(int row = 0; row < this->NumberOfRows; row++){
+        double norm = 0.0;
+        for(int i = 0; i < this->Dimensions; i++){
+            double value = (this->Type == STORE_UINT8) ? (double)get_byte_row(row)[i] : (double)get_row(row)[i];
+            norm += value * value;
+        }
+        this->RowNorms[row] = norm;
+    }
+}
+
+DatasetStore::~DatasetStore(){
+    free(this->Rows);
+    free(this->ByteRows);
+}
+
+StorageType DatasetStore::get_storage_type(){
+    return this->Type;
+}
+int DatasetStore::size(){
+    return this->NumberOfRows;
+}
+int DatasetStore::get_dimensions(){
+    return this->Dimensions;
+}
+int DatasetStore::get_stride(){
+    return this->Stride;
+}
+void DatasetStore::copy_row(int row, float* destination){
+    int i;
+    if(this->Order.empty()){
+        if(this->Type == STORE_UINT8){
+            const unsigned char* source = get_byte_row(row);
+            for(i = 0; i < this->Stride; i++) destination[i] = (float)source[i];
+        }
+        else{
+            memcpy(destination, get_row(row), this->Stride * sizeof(float));
+        }
+        return;
+    }
+
+    // Scattered straight back to the original positions, the row is only read so nothing has to be copied first
+    if(this->Type == STORE_UINT8){
+        const unsigned char* source = get_byte_row(row);
+        for(i = 0; i < this->Dimensions; i++) destination[this->Order[i]] = (float)source[i];
+    }
+    else{
+        const float* source = get_row(row);
+        for(i = 0; i < this->Dimensions; i++) destination[this->Order[i]] = source[i];
+    }
+    for(i = this->Dimensions; i < this->Stride; i++) destination[i] = 0.0f; // The padding is zeros either way
+}
+
+void DatasetStore::order_dimensions_by_variance(){
+    int row, i;
+    double value;
+    std::vector<double> sum(this->Dimensions, 0.0), sumOfSquares(this->Dimensions, 0.0);
+    std::vector<std::pair<double, int>> variances(this->Dimensions);
+
+    if(!this->Order.empty() || this->NumberOfRows == 0) return;
+
+    for(row = 0; row < this->NumberOfRows; row++){
+        for(i = 0; i < this->Dimensions; i++){
+            value = (this->Type == STORE_UINT8) ? (double)get_byte_row(row)[i] : (double)get_row(row)[i];
+            sum[i] += value;
+            sumOfSquares[i] += value * value;
+        }
+    }
+    for(i = 0; i < this->Dimensions; i++){
+        double mean = sum[i] / this->NumberOfRows;
+        variances[i] = std::make_pair(-(sumOfSquares[i] / this->NumberOfRows - mean * mean), i); // Negated so the sort is descending
+    }
+    std::stable_sort(variances.begin(), variances.end());
+
+    this->Order.resize(this->Dimensions);
+    for(i = 0; i < this->Dimensions; i++) this->Order[i] = variances[i].second;
+
+    // Permute every row in place, the padding stays where it is
+    for(row = 0; row < this->NumberOfRows; row++){
+        if(this->Type == STORE_UINT8){
+            unsigned char* destination = this->ByteRows + (size_t)row * this->Stride;
+            std::vector<unsigned char> original(destination, destination + this->Dimensions);
+            for(i = 0; i < this->Dimensions; i++) destination[i] = original[this->Order[i]];
+        }
+        else{
+            float* destination = this->Rows + (size_t)row * this->Stride;
+            std::vector<float> original(destination, destination + this->Dimensions);
+            for(i = 0; i < this->Dimensions; i++) destination[i] = original[this->Order[i]];
+        }
+    }
+}
+
+int DatasetStore::get_number(int row){
+    if(!this->Numbers.empty()) return this->Numbers[row];
+    return this->FirstNumber + row;
+}
+
+int DatasetStore::get_row_of_number(int number){
+    if(!this->Numbers.empty()){
+        auto it = this->NumberToRow.find(number);
+        return (it == this->NumberToRow.end()) ? -1 : it->second;
+    }
+    int row = number - this->FirstNumber;
+    return (row >= 0 && row < this->NumberOfRows) ? row : -1;
+}
+
+std::shared_ptr<ImageVector> DatasetStore::get_image(int row){
+    if(this->Images[row] == nullptr){
+        std::vector<double> coordinates(this->Dimensions);
+        for(int i = 0; i < this->Dimensions; i++){
+            int dimension = this->Order.empty() ? i : this->Order[i];
+            coordinates[dimension] = (this->Type == STORE_UINT8) ? (double)get_byte_row(row)[i] : (double)get_row(row)[i];
+        }
+        this->Images[row] = std::make_shared<ImageVector>(get_number(row), coordinates);
+    }
+    return this->Images[row];
+}
+
+StoreQuery DatasetStore::make_query(const std::vector<double>& coordinates, int number){
+    StoreQuery query;
+    bool bytes = (this->Type == STORE_UINT8);
+    int i, dimension;
+
+    query.Number = number;
+    query.Floats.assign(this->Stride, 0.0f);
+    for(i = 0; i < this->Dimensions && i < (int)coordinates.size(); i++){
+        query.Floats[i] = (float)coordinates[i];
+        if(bytes && !is_byte(coordinates[i])) bytes = false;
+    }
+    if(!this->Order.empty()){
+        query.OrderedFloats.assign(this->Stride, 0.0f);
+        for(i = 0; i < this->Dimensions; i++) query.OrderedFloats[i] = query.Floats[this->Order[i]];
+    }
+
+    query.Norm = 0.0;
+    for(i = 0; i < this->Dimensions; i++) query.Norm += (double)query.Floats[i] * (double)query.Floats[i];
+
+    if(bytes){
+        query.Bytes.assign(this->Stride, 0);
+        for(i = 0; i < this->Dimensions; i++){
+            dimension = this->Order.empty() ? i : this->Order[i];
+            if(dimension < (int)coordinates.size()) query.Bytes[i] = (unsigned char)coordinates[dimension];
+        }
+    }
+    return query;
+}
+
+StoreQuery DatasetStore::make_query(std::shared_ptr<ImageVector> image){
+    return make_query(image->get_coordinates(), image->get_number());
+}
+
+StoreQuery DatasetStore::make_query_from_row(int row){
+    StoreQuery query;
+
+    query.Number = get_number(row);
+    query.Norm = this->RowNorms[row];
+    query.Floats.resize(this->Stride);
+    copy_row(row, query.Floats.data());
+    if(this->Type == STORE_UINT8){
+        query.Bytes.assign(get_byte_row(row), get_byte_row(row) + this->Stride);
+    }
+    // Whatever the storage, ordered_data() has to be in the order of the store. The byte searches don't read it, but the
+    // batch distances do when the query is mixed with float ones
+    if(!this->Order.empty()){
+        if(this->Type == STORE_UINT8){
+            query.OrderedFloats.assign(get_byte_row(row), get_byte_row(row) + this->Stride); // Widened to floats
+        }
+        else{
+            query.OrderedFloats.assign(get_row(row), get_row(row) + this->Stride);
+        }
+    }
+    return query;
+}
+
+double DatasetStore::distance(const StoreQuery& query, int row, Metric* metric){
+    return metric->to_distance(comparison_distance(query, row, metric));
+}
+
+double DatasetStore::distance_between_rows(int row1, int row2, Metric* metric){
+    return metric->to_distance(comparison_distance_between_rows(row1, row2, metric));
+}
+
+double DatasetStore::comparison_distance(const StoreQuery& query, int row, Metric* metric){
+    if(this->Type == STORE_FLOAT32){
+        return metric->comparison_distance(query.ordered_data(), get_row(row), this->Dimensions);
+    }
+    if(!query.Bytes.empty()){
+        return metric->comparison_distance(query.Bytes.data(), get_byte_row(row), this->Dimensions);
+    }
+    return metric->comparison_distance(query.ordered_data(), get_byte_row(row), this->Dimensions);
+}
+
+double DatasetStore::bounded_comparison_distance(const StoreQuery& query, int row, Metric* metric, double bound){
+    if(this->Type == STORE_FLOAT32){
+        return metric->bounded_comparison_distance(query.ordered_data(), get_row(row), this->Dimensions, bound);
+    }
+    if(!query.Bytes.empty()){
+        return metric->bounded_comparison_distance(query.Bytes.data(), get_byte_row(row), this->Dimensions, bound);
+    }
+    return metric->bounded_comparison_distance(query.ordered_data(), get_byte_row(row), this->Dimensions, bound);
+}
+
+SearchKernels DatasetStore::search_kernels(Metric* metric){
+    return SearchKernels(metric, this->Dimensions);
+}
+
+double DatasetStore::comparison_distance_between_rows(int row1, int row2, Metric* metric){
+    if(this->Type == STORE_UINT8){
+        return metric->comparison_distance(get_byte_row(row1), get_byte_row(row2), this->Dimensions);
+    }
+    return metric->comparison_distance(get_row(row1), get_row(row2), this->Dimensions);
+}
+
+void DatasetStore::fallback_comparison_distances(const std::vector<const StoreQuery*>& queries, const int* rows, int numberOfRows, Metric* metric, double* distances){
+    for(int q = 0; q < (int)queries.size(); q++){
+        for(int r = 0; r < numberOfRows; r++){
+            distances[(size_t)q * numberOfRows + r] = comparison_distance(*queries[q], rows[r], metric);
+        }
+    }
+}
+
+void DatasetStore::comparison_distances(const std::vector<const StoreQuery*>& queries, const int* rows, int numberOfRows, Metric* metric, double* distances){
+    int q, r;
+    int numberOfQueries = (int)queries.size();
+    size_t index;
+
+    if(!metric->supports_norm_expansion()){
+        fallback_comparison_distances(queries, rows, numberOfRows, metric, distances);
+        return;
+    }
+
+    bool allBytes = true;
+    for(q = 0; q < numberOfQueries; q++) allBytes = allBytes && !queries[q]->Bytes.empty();
+
+    if(this->Type == STORE_UINT8 && allBytes){
+        // Queries made of bytes go through the integer kernel, and then the whole thing is exact
+        std::vector<const unsigned char*> queryPointers(numberOfQueries), rowPointers(numberOfRows);
+        for(q = 0; q < numberOfQueries; q++) queryPointers[q] = queries[q]->Bytes.data();
+        for(r = 0; r < numberOfRows; r++) rowPointers[r] = get_byte_row(rows[r]);
+
+        std::vector<uint32_t> dots((size_t)numberOfQueries * numberOfRows);
+        dot_products_u8(queryPointers.data(), numberOfQueries, rowPointers.data(), numberOfRows, this->Dimensions, dots.data());
+        for(q = 0; q < numberOfQueries; q++){
+            for(r = 0; r < numberOfRows; r++){
+                index = (size_t)q * numberOfRows + r;
+                distances[index] = queries[q]->Norm - 2.0 * (double)dots[index] + this->RowNorms[rows[r]];
+            }
+        }
+        return;
+    }
+
+    std::vector<const float*> queryPointers(numberOfQueries);
+    for(q = 0; q < numberOfQueries; q++) queryPointers[q] = queries[q]->ordered_data();
+
+    std::vector<float> dots((size_t)numberOfQueries * numberOfRows);
+    if(this->Type == STORE_UINT8){
+        std::vector<const unsigned char*> rowPointers(numberOfRows);
+        for(r = 0; r < numberOfRows; r++) rowPointers[r] = get_byte_row(rows[r]);
+        dot_products_f32_u8(queryPointers.data(), numberOfQueries, rowPointers.data(), numberOfRows, this->Dimensions, dots.data());
+    }
+    else{
+        std::vector<const float*> rowPointers(numberOfRows);
+        for(r = 0; r < numberOfRows; r++) rowPointers[r] = get_row(rows[r]);
+        dot_products_f32(queryPointers.data(), numberOfQueries, rowPointers.data(), numberOfRows, this->Dimensions, dots.data());
+    }
+    for(q = 0; q < numberOfQueries; q++){
+        for(r = 0; r < numberOfRows; r++){
+            index = (size_t)q * numberOfRows + r;
+            distances[index] = std::max(0.0, queries[q]->Norm - 2.0 * (double)dots[index] + this->RowNorms[rows[r]]); // Rounding can take it slightly below zero
+        }
+    }
+}
+
+bool DatasetStore::exact_comparison_distances(const StoreQuery& query, Metric* metric){
+    return !metric->supports_norm_expansion() || (this->Type == STORE_UINT8 && !query.Bytes.empty());
+}
+
+double DatasetStore::comparison_distances_error(const StoreQuery& query, int row){
+    // A float sum of Dimensions products is off by at most Dimensions epsilons of the sum of their absolute values,
+    // which is at most (|q|^2 + |r|^2) / 2, and the dot product counts twice
+    return (double)this->Dimensions * FLT_EPSILON * (query.Norm + this->RowNorms[row]);
+}
+
+void DatasetStore::comparison_distances(const std::vector<const StoreQuery*>& queries, int firstRow, int numberOfRows, Metric* metric, double* distances){
+    std::vector<int> rows(numberOfRows);
+    for(int r = 0; r < numberOfRows; r++) rows[r] = firstRow + r;
+    comparison_distances(queries, rows.data(), numberOfRows, metric, distances);
+}
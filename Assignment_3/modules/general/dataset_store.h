@@ -0,0 +1,167 @@
+#ifndef DATASET_STORE_H
+#define DATASET_STORE_H
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "image_util.h"
+#include "io_functions.h"
+#include "metrics.h"
+#include "search_kernels.h"
+
+#define STORE_ALIGNMENT 64 // Bytes, every row starts on its own cache line
+#define STORE_ROW_PADDING 16 // Float rows are zero padded to a multiple of 16 floats so that kernels can read whole blocks
+#define STORE_BYTE_ROW_PADDING 64 // Same for uint8 rows, in bytes
+#define STORE_PREFETCH_ROWS 2 // How far ahead of the row being scored the batch distances ask for the next rows
+
+enum StorageType{
+    STORE_FLOAT32, // Anything goes
+    STORE_UINT8 // Pixels and reduce.py encodings, 4 times smaller and the distances are exact integer sums
+};
+
+// A query prepared for the rows of a specific store, see DatasetStore::make_query
+class StoreQuery{
+    public:
+    int Number; // The image number of the query, so that the searches can ignore it
+    std::vector<float> Floats; // Zero padded to the stride of the store, this is what the hash functions project
+    std::vector<unsigned char> Bytes; // Only for uint8 stores, and only when every coordinate is a whole number in [0, 255]
+    std::vector<float> OrderedFloats; // Floats in the dimension order of the store, empty when the store keeps the original order
+    double Norm; // Squared length, for the batch distances
+
+    const float* data() const { return Floats.data(); }
+    const float* ordered_data() const { return OrderedFloats.empty() ? Floats.data() : OrderedFloats.data(); }
+};
+
+// The whole dataset as one row-major matrix. The indexes refer to the images by their row id (0 to size()-1)
+// and only turn them back into ImageVectors when they return their results
+class DatasetStore{
+    StorageType Type;
+    int NumberOfRows;
+    int Dimensions;
+    int Stride; // Dimensions rounded up to the row padding of the storage type
+    float* Rows; // STORE_FLOAT32
+    unsigned char* ByteRows; // STORE_UINT8
+
+    int FirstNumber; // The image numbers are almost always consecutive, so number = FirstNumber + row
+    std::vector<int> Numbers; // Only filled when they are not
+    std::unordered_map<int, int> NumberToRow;
+
+    std::vector<std::shared_ptr<ImageVector>> Images; // Row id -> the image we hand back, created on demand for mapped datasets
+
+    std::vector<int> Order; // Position in a row -> original dimension, empty when the rows keep the original order
+
+    std::vector<double> RowNorms; // Squared length of every row
+
+    void compute_row_norms();
+    void fallback_comparison_distances(const std::vector<const StoreQuery*>& queries, const int* rows, int numberOfRows, Metric* metric, double* distances);
+
+    void allocate(int numberOfRows, int dimensions);
+
+    public:
+    DatasetStore(const std::vector<std::shared_ptr<ImageVector>>& images, StorageType type = STORE_FLOAT32);
+    // Same numbering as read_mnist_images. The rows are copied out of the mapping, once and without any ImageVector: the kernels
+    // want every row on its own cache line and zero padded (784 pixels are not a multiple of 64), and the mapping has neither
+    DatasetStore(MappedImages& mapped, int imagesAlreadyRead, StorageType type = STORE_FLOAT32);
+    ~DatasetStore();
+    DatasetStore(const DatasetStore&) = delete;
+    DatasetStore& operator=(const DatasetStore&) = delete;
+
+    StorageType get_storage_type();
+    int size();
+    int get_dimensions();
+    int get_stride();
+    const float* get_row(int row); // STORE_FLOAT32 only, in the dimension order of the store
+    const unsigned char* get_byte_row(int row); // STORE_UINT8 only, in the dimension order of the store
+    void copy_row(int row, float* destination); // Works for both and in the original order, destination needs get_stride() floats
+
+    // Moves the dimensions with the largest variance to the front of every row, so the bounded distances can give up
+    // on a far candidate sooner (most MNIST pixels are almost always zero). Call it before the indexes load the store
+    void order_dimensions_by_variance();
+    int get_number(int row);
+    int get_row_of_number(int number); // -1 if the image is not in the store
+    std::shared_ptr<ImageVector> get_image(int row); // Not thread safe, it may create the image
+
+    StoreQuery make_query(const std::vector<double>& coordinates, int number);
+    StoreQuery make_query(std::shared_ptr<ImageVector> image);
+    StoreQuery make_query_from_row(int row);
+
+    // The metric is applied to whatever the rows are stored as
+    double distance(const StoreQuery& query, int row, Metric* metric);
+    double distance_between_rows(int row1, int row2, Metric* metric);
+    double comparison_distance(const StoreQuery& query, int row, Metric* metric); // See Metric::comparison_distance
+    double comparison_distance_between_rows(int row1, int row2, Metric* metric);
+    double bounded_comparison_distance(const StoreQuery& query, int row, Metric* metric, double bound); // See Metric::bounded_comparison_distance
+
+    // The same with the distances an index picked once, these are inlined into the search loops
+    SearchKernels search_kernels(Metric* metric);
+    double comparison_distance(const StoreQuery& query, int row, const SearchKernels& kernels);
+    double comparison_distance_between_rows(int row1, int row2, const SearchKernels& kernels);
+    double bounded_comparison_distance(const StoreQuery& query, int row, const SearchKernels& kernels, double bound);
+    void prefetch_row(int row); // Asks for every cache line of the row, for when it will be read a little later
+    // One query against a list of rows, distances[i] for rows[i]. Meant for the rows sorted, so that they are read in the
+    // order they sit in memory, and the rows a few places ahead are prefetched while one is scored. Allocates nothing
+    void comparison_distances(const StoreQuery& query, const int* rows, int numberOfRows, const SearchKernels& kernels, double* distances);
+
+    // Every query against every one of the rows, distances[q * numberOfRows + r]. With a metric that supports the norm expansion
+    // this is a tiled dot product over the cached row norms and every row is read once per DOT_QUERY_TILE queries
+    void comparison_distances(const std::vector<const StoreQuery*>& queries, const int* rows, int numberOfRows, Metric* metric, double* distances);
+    void comparison_distances(const std::vector<const StoreQuery*>& queries, int firstRow, int numberOfRows, Metric* metric, double* distances); // The rows firstRow to firstRow + numberOfRows - 1
+    // Whether those are the exact comparison distances for the query: they are without the norm expansion and with it
+    // for byte queries on a uint8 store. Otherwise the dot products are float sums and one of them is off by at most
+    // comparison_distances_error, which on MNIST is around 1 in distances of 1e6, so results have to be scored again
+    bool exact_comparison_distances(const StoreQuery& query, Metric* metric);
+    double comparison_distances_error(const StoreQuery& query, int row);
+};
+
+inline const float* DatasetStore::get_row(int row){
+    return this->Rows + (size_t)row * this->Stride;
+}
+
+inline const unsigned char* DatasetStore::get_byte_row(int row){
+    return this->ByteRows + (size_t)row * this->Stride;
+}
+
+inline double DatasetStore::comparison_distance(const StoreQuery& query, int row, const SearchKernels& kernels){
+    if(this->Type == STORE_FLOAT32){
+        return kernels.comparison_distance(query.ordered_data(), get_row(row));
+    }
+    if(!query.Bytes.empty()){
+        return kernels.comparison_distance(query.Bytes.data(), get_byte_row(row));
+    }
+    return kernels.comparison_distance(query.ordered_data(), get_byte_row(row));
+}
+
+inline double DatasetStore::comparison_distance_between_rows(int row1, int row2, const SearchKernels& kernels){
+    if(this->Type == STORE_UINT8){
+        return kernels.comparison_distance(get_byte_row(row1), get_byte_row(row2));
+    }
+    return kernels.comparison_distance(get_row(row1), get_row(row2));
+}
+
+inline double DatasetStore::bounded_comparison_distance(const StoreQuery& query, int row, const SearchKernels& kernels, double bound){
+    if(this->Type == STORE_FLOAT32){
+        return kernels.bounded_comparison_distance(query.ordered_data(), get_row(row), bound);
+    }
+    if(!query.Bytes.empty()){
+        return kernels.bounded_comparison_distance(query.Bytes.data(), get_byte_row(row), bound);
+    }
+    return kernels.bounded_comparison_distance(query.ordered_data(), get_byte_row(row), bound);
+}
+
+inline void DatasetStore::prefetch_row(int row){
+    const char* start = (this->Type == STORE_FLOAT32) ? (const char*)get_row(row) : (const char*)get_byte_row(row);
+    size_t bytes = (this->Type == STORE_FLOAT32) ? this->Stride * sizeof(float) : this->Stride;
+    for(size_t offset = 0; offset < bytes; offset += STORE_ALIGNMENT){
+        __builtin_prefetch(start + offset);
+    }
+}
+
+inline void DatasetStore::comparison_distances(const StoreQuery& query, const int* rows, int numberOfRows, const SearchKernels& kernels, double* distances){
+    for(int i = 0; i < numberOfRows; i++){
+        if(i + STORE_PREFETCH_ROWS < numberOfRows) prefetch_row(rows[i + STORE_PREFETCH_ROWS]);
+        distances[i] = comparison_distance(query, rows[i], kernels);
+    }
+}
+
+#endif
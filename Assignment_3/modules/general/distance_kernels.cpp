@@ -0,0 +1,863 @@
+#include "distance_kernels.h"
+
+#include <immintrin.h>
+
+// ------------------------------------------------------------------------------ //
+// ----------------------------------- Scalar ----------------------------------- //
+// ------------------------------------------------------------------------------ //
+
+static uint32_t squared_l2_u8_scalar(const unsigned char* p1, const unsigned char* p2, int size){
+    uint32_t sum = 0;
+    int difference;
+    for(int i = 0; i < size; i++){
+        difference = (int)p1[i] - (int)p2[i];
+        sum += (uint32_t)(difference * difference);
+    }
+    return sum;
+}
+
+static float squared_l2_f32_u8_scalar(const float* p1, const unsigned char* p2, int size){
+    float sum = 0.0f;
+    float difference;
+    for(int i = 0; i < size; i++){
+        difference = p1[i] - (float)p2[i];
+        sum += difference * difference;
+    }
+    return sum;
+}
+
+static float squared_l2_f32_scalar(const float* p1, const float* p2, int size){
+    float sum = 0.0f;
+    float difference;
+    for(int i = 0; i < size; i++){
+        difference = p1[i] - p2[i];
+        sum += difference * difference;
+    }
+    return sum;
+}
+
+static double squared_l2_f64_scalar(const double* p1, const double* p2, int size){
+    double sum = 0.0;
+    double difference;
+    for(int i = 0; i < size; i++){
+        difference = p1[i] - p2[i];
+        sum += difference * difference;
+    }
+    return sum;
+}
+
+// ------------------------------------------------------------------------------ //
+// ------------------------------------ SSE2 ------------------------------------ //
+// ------------------------------------------------------------------------------ //
+
+// Widen 16 bytes to two halves of 8 int16, subtract and let madd square and add the neighboring pairs into int32.
+// The differences are in [-255, 255] so every pair sum is at most 2 * 65025 and nothing overflows
+__attribute__((target("sse2")))
+static uint32_t squared_l2_u8_sse2(const unsigned char* p1, const unsigned char* p2, int size){
+    int i = 0;
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+
+    for(; i + 16 <= size; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i*)(p1 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p2 + i));
+        __m128i differenceLow = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i differenceHigh = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(differenceLow, differenceLow));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(differenceHigh, differenceHigh));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return (uint32_t)_mm_cvtsi128_si32(sum) + squared_l2_u8_scalar(p1 + i, p2 + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static float squared_l2_f32_sse2(const float* p1, const float* p2, int size){
+    int i = 0;
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+
+    for(; i + 8 <= size; i += 8){
+        __m128 difference0 = _mm_sub_ps(_mm_loadu_ps(p1 + i), _mm_loadu_ps(p2 + i));
+        __m128 difference1 = _mm_sub_ps(_mm_loadu_ps(p1 + i + 4), _mm_loadu_ps(p2 + i + 4));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(difference0, difference0));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(difference1, difference1));
+    }
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+    sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+
+    return _mm_cvtss_f32(sum0) + squared_l2_f32_scalar(p1 + i, p2 + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static double squared_l2_f64_sse2(const double* p1, const double* p2, int size){
+    int i = 0;
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+
+    for(; i + 4 <= size; i += 4){
+        __m128d difference0 = _mm_sub_pd(_mm_loadu_pd(p1 + i), _mm_loadu_pd(p2 + i));
+        __m128d difference1 = _mm_sub_pd(_mm_loadu_pd(p1 + i + 2), _mm_loadu_pd(p2 + i + 2));
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(difference0, difference0));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(difference1, difference1));
+    }
+    sum0 = _mm_add_pd(sum0, sum1);
+    sum0 = _mm_add_sd(sum0, _mm_unpackhi_pd(sum0, sum0));
+
+    return _mm_cvtsd_f64(sum0) + squared_l2_f64_scalar(p1 + i, p2 + i, size - i);
+}
+
+// ------------------------------------------------------------------------------ //
+// ------------------------------------ AVX2 ------------------------------------ //
+// ------------------------------------------------------------------------------ //
+
+__attribute__((target("avx2")))
+static uint32_t squared_l2_u8_avx2(const unsigned char* p1, const unsigned char* p2, int size){
+    int i = 0;
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+
+    for(; i + 32 <= size; i += 32){
+        __m256i difference0 = _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i))),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i))));
+        __m256i difference1 = _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i + 16))),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i + 16))));
+        sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(difference0, difference0));
+        sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(difference1, difference1));
+    }
+    for(; i + 16 <= size; i += 16){
+        __m256i difference = _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i))),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i))));
+        sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(difference, difference));
+    }
+    sum0 = _mm256_add_epi32(sum0, sum1);
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sum0), _mm256_extracti128_si256(sum0, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return (uint32_t)_mm_cvtsi128_si32(sum) + squared_l2_u8_scalar(p1 + i, p2 + i, size - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float squared_l2_f32_u8_avx2(const float* p1, const unsigned char* p2, int size){
+    int i = 0;
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    for(; i + 16 <= size; i += 16){
+        __m256 b0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p2 + i))));
+        __m256 b1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p2 + i + 8))));
+        __m256 difference0 = _mm256_sub_ps(_mm256_loadu_ps(p1 + i), b0);
+        __m256 difference1 = _mm256_sub_ps(_mm256_loadu_ps(p1 + i + 8), b1);
+        sum0 = _mm256_fmadd_ps(difference0, difference0, sum0);
+        sum1 = _mm256_fmadd_ps(difference1, difference1, sum1);
+    }
+    sum0 = _mm256_add_ps(sum0, sum1);
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum) + squared_l2_f32_u8_scalar(p1 + i, p2 + i, size - i);
+}
+
+// Two accumulators so that consecutive FMAs don't wait on each other
+__attribute__((target("avx2,fma")))
+static float squared_l2_f32_avx2(const float* p1, const float* p2, int size){
+    int i = 0;
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    for(; i + 16 <= size; i += 16){
+        __m256 difference0 = _mm256_sub_ps(_mm256_loadu_ps(p1 + i), _mm256_loadu_ps(p2 + i));
+        __m256 difference1 = _mm256_sub_ps(_mm256_loadu_ps(p1 + i + 8), _mm256_loadu_ps(p2 + i + 8));
+        sum0 = _mm256_fmadd_ps(difference0, difference0, sum0);
+        sum1 = _mm256_fmadd_ps(difference1, difference1, sum1);
+    }
+    if(i + 8 <= size){
+        __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(p1 + i), _mm256_loadu_ps(p2 + i));
+        sum0 = _mm256_fmadd_ps(difference, difference, sum0);
+        i += 8;
+    }
+    sum0 = _mm256_add_ps(sum0, sum1);
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum) + squared_l2_f32_scalar(p1 + i, p2 + i, size - i);
+}
+
+__attribute__((target("avx2,fma")))
+static double squared_l2_f64_avx2(const double* p1, const double* p2, int size){
+    int i = 0;
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+
+    for(; i + 8 <= size; i += 8){
+        __m256d difference0 = _mm256_sub_pd(_mm256_loadu_pd(p1 + i), _mm256_loadu_pd(p2 + i));
+        __m256d difference1 = _mm256_sub_pd(_mm256_loadu_pd(p1 + i + 4), _mm256_loadu_pd(p2 + i + 4));
+        sum0 = _mm256_fmadd_pd(difference0, difference0, sum0);
+        sum1 = _mm256_fmadd_pd(difference1, difference1, sum1);
+    }
+    sum0 = _mm256_add_pd(sum0, sum1);
+
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(sum0), _mm256_extractf128_pd(sum0, 1));
+    sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+
+    return _mm_cvtsd_f64(sum) + squared_l2_f64_scalar(p1 + i, p2 + i, size - i);
+}
+
+// ------------------------------------------------------------------------------ //
+// ----------------------------------- AVX-512 ---------------------------------- //
+// ------------------------------------------------------------------------------ //
+
+// The unmasked 512 to 256 bit extracts (and _mm512_reduce_add_*, which uses them) trip -Wuninitialized inside
+// the GCC 12 headers, so the halves are taken with a masked extract over zero instead
+__attribute__((target("avx512f")))
+static __m256d half_avx512(__m512d v, const int high){
+    return high ? _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, v, 1) : _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, v, 0);
+}
+
+__attribute__((target("avx512f")))
+static float horizontal_sum_avx512(__m512 v){
+    __m256 half = _mm256_add_ps(_mm256_castpd_ps(half_avx512(_mm512_castps_pd(v), 0)), _mm256_castpd_ps(half_avx512(_mm512_castps_pd(v), 1)));
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(half), _mm256_extractf128_ps(half, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx512f")))
+static double horizontal_sum_avx512(__m512d v){
+    __m256d half = _mm256_add_pd(half_avx512(v, 0), half_avx512(v, 1));
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(half), _mm256_extractf128_pd(half, 1));
+    sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+    return _mm_cvtsd_f64(sum);
+}
+
+// The tail is handled with a masked load, the masked out lanes read as zero on both sides
+__attribute__((target("avx512f")))
+static float squared_l2_f32_avx512(const float* p1, const float* p2, int size){
+    int i = 0;
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+
+    for(; i + 32 <= size; i += 32){
+        __m512 difference0 = _mm512_sub_ps(_mm512_loadu_ps(p1 + i), _mm512_loadu_ps(p2 + i));
+        __m512 difference1 = _mm512_sub_ps(_mm512_loadu_ps(p1 + i + 16), _mm512_loadu_ps(p2 + i + 16));
+        sum0 = _mm512_fmadd_ps(difference0, difference0, sum0);
+        sum1 = _mm512_fmadd_ps(difference1, difference1, sum1);
+    }
+    for(; i < size; i += 16){
+        __mmask16 mask = (size - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (size - i)) - 1);
+        __m512 difference = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, p1 + i), _mm512_maskz_loadu_ps(mask, p2 + i));
+        sum0 = _mm512_fmadd_ps(difference, difference, sum0);
+    }
+    return horizontal_sum_avx512(_mm512_add_ps(sum0, sum1));
+}
+
+__attribute__((target("avx512f")))
+static double squared_l2_f64_avx512(const double* p1, const double* p2, int size){
+    int i = 0;
+    __m512d sum0 = _mm512_setzero_pd();
+    __m512d sum1 = _mm512_setzero_pd();
+
+    for(; i + 16 <= size; i += 16){
+        __m512d difference0 = _mm512_sub_pd(_mm512_loadu_pd(p1 + i), _mm512_loadu_pd(p2 + i));
+        __m512d difference1 = _mm512_sub_pd(_mm512_loadu_pd(p1 + i + 8), _mm512_loadu_pd(p2 + i + 8));
+        sum0 = _mm512_fmadd_pd(difference0, difference0, sum0);
+        sum1 = _mm512_fmadd_pd(difference1, difference1, sum1);
+    }
+    for(; i < size; i += 8){
+        __mmask8 mask = (size - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (size - i)) - 1);
+        __m512d difference = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, p1 + i), _mm512_maskz_loadu_pd(mask, p2 + i));
+        sum0 = _mm512_fmadd_pd(difference, difference, sum0);
+    }
+    return horizontal_sum_avx512(_mm512_add_pd(sum0, sum1));
+}
+
+// ------------------------------------------------------------------------------ //
+// ------------------------------- Early abandoning ----------------------------- //
+// ------------------------------------------------------------------------------ //
+
+// Runs the kernel one block at a time and stops as soon as the partial sum is over the bound.
+// The sums only grow so the result is exact whenever it is within the bound
+template <typename Sum, typename T1, typename T2, Sum (*Kernel)(const T1*, const T2*, int)>
+static Sum bounded(const T1* p1, const T2* p2, int size, Sum bound){
+    Sum sum = 0;
+    for(int i = 0; i < size; i += DISTANCE_BLOCK){
+        sum += Kernel(p1 + i, p2 + i, (size - i < DISTANCE_BLOCK) ? size - i : DISTANCE_BLOCK);
+        if(sum > bound) break;
+    }
+    return sum;
+}
+
+// The uint8 path is the one the comparisons run on, so it checks the bound inside the vector loop instead
+__attribute__((target("avx2")))
+static uint32_t bounded_squared_l2_u8_avx2(const unsigned char* p1, const unsigned char* p2, int size, uint32_t bound){
+    int i = 0, block;
+    uint32_t total = 0;
+    __m128i sum;
+
+    while(i + 32 <= size){
+        __m256i sum0 = _mm256_setzero_si256();
+        for(block = 0; block < DISTANCE_BLOCK && i + 32 <= size; block += 32, i += 32){
+            __m256i difference0 = _mm256_sub_epi16(
+                _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i))),
+                _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i))));
+            __m256i difference1 = _mm256_sub_epi16(
+                _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i + 16))),
+                _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i + 16))));
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(difference0, difference0));
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(difference1, difference1));
+        }
+        sum = _mm_add_epi32(_mm256_castsi256_si128(sum0), _mm256_extracti128_si256(sum0, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        total += (uint32_t)_mm_cvtsi128_si32(sum);
+        if(total > bound) return total;
+    }
+    return total + squared_l2_u8_avx2(p1 + i, p2 + i, size - i);
+}
+
+// ------------------------------------------------------------------------------ //
+// -------------------------------- Dot products -------------------------------- //
+// ------------------------------------------------------------------------------ //
+
+// Every tile reads a row once and multiplies it with up to DOT_QUERY_TILE queries, and the rows are visited in blocks
+// of DOT_ROW_BLOCK so that a block is still in the cache when the next tile of queries goes over it
+
+static void dot_products_u8_scalar(const unsigned char* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, uint32_t* out){
+    for(int q = 0; q < numberOfQueries; q++){
+        for(int r = 0; r < numberOfRows; r++){
+            uint32_t sum = 0;
+            for(int i = 0; i < size; i++) sum += (uint32_t)queries[q][i] * (uint32_t)rows[r][i];
+            out[(size_t)q * numberOfRows + r] = sum;
+        }
+    }
+}
+
+static void dot_products_f32_scalar(const float* const* queries, int numberOfQueries, const float* const* rows, int numberOfRows, int size, float* out){
+    for(int q = 0; q < numberOfQueries; q++){
+        for(int r = 0; r < numberOfRows; r++){
+            float sum = 0.0f;
+            for(int i = 0; i < size; i++) sum += queries[q][i] * rows[r][i];
+            out[(size_t)q * numberOfRows + r] = sum;
+        }
+    }
+}
+
+static void dot_products_f32_u8_scalar(const float* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, float* out){
+    for(int q = 0; q < numberOfQueries; q++){
+        for(int r = 0; r < numberOfRows; r++){
+            float sum = 0.0f;
+            for(int i = 0; i < size; i++) sum += queries[q][i] * (float)rows[r][i];
+            out[(size_t)q * numberOfRows + r] = sum;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t horizontal_sum_avx2(__m256i v){
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static inline float horizontal_sum_avx2(__m256 v){
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// The products of two bytes fit in int16 lanes after widening, and madd adds them in pairs into int32 without overflowing
+__attribute__((target("avx2")))
+static void dot_products_u8_avx2(const unsigned char* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, uint32_t* out){
+    int block, tile, r, q, i, tileSize, blockEnd;
+    int vectorSize = size - size % 16;
+
+    for(block = 0; block < numberOfRows; block += DOT_ROW_BLOCK){
+        blockEnd = (block + DOT_ROW_BLOCK < numberOfRows) ? block + DOT_ROW_BLOCK : numberOfRows;
+        for(tile = 0; tile < numberOfQueries; tile += DOT_QUERY_TILE){
+            tileSize = (numberOfQueries - tile < DOT_QUERY_TILE) ? numberOfQueries - tile : DOT_QUERY_TILE;
+            const unsigned char* q0 = queries[tile];
+            const unsigned char* q1 = queries[tile + (tileSize > 1 ? 1 : 0)]; // Short tiles repeat their first query and ignore the result
+            const unsigned char* q2 = queries[tile + (tileSize > 2 ? 2 : 0)];
+            const unsigned char* q3 = queries[tile + (tileSize > 3 ? 3 : 0)];
+            if(tileSize == 1){ // A lone query, nothing to share the loads with
+                for(r = block; r < blockEnd; r++){
+                    __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+                    for(i = 0; i + 32 <= vectorSize; i += 32){
+                        sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[r] + i))),
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q0 + i)))));
+                        sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[r] + i + 16))),
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q0 + i + 16)))));
+                    }
+                    for(; i < vectorSize; i += 16){
+                        sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[r] + i))),
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q0 + i)))));
+                    }
+                    uint32_t dot = horizontal_sum_avx2(_mm256_add_epi32(sum0, sum1));
+                    for(i = vectorSize; i < size; i++) dot += (uint32_t)q0[i] * (uint32_t)rows[r][i];
+                    out[(size_t)tile * numberOfRows + r] = dot;
+                }
+                continue;
+            }
+            for(r = block; r < blockEnd; r++){
+                const unsigned char* row = rows[r];
+                __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+                __m256i sum2 = _mm256_setzero_si256(), sum3 = _mm256_setzero_si256();
+                for(i = 0; i < vectorSize; i += 16){
+                    __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row + i)));
+                    sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(x, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q0 + i)))));
+                    sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(x, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q1 + i)))));
+                    sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(x, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q2 + i)))));
+                    sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(x, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(q3 + i)))));
+                }
+                uint32_t dots[DOT_QUERY_TILE] = {horizontal_sum_avx2(sum0), horizontal_sum_avx2(sum1), horizontal_sum_avx2(sum2), horizontal_sum_avx2(sum3)};
+                for(q = 0; q < tileSize; q++){
+                    for(i = vectorSize; i < size; i++) dots[q] += (uint32_t)queries[tile + q][i] * (uint32_t)row[i];
+                    out[(size_t)(tile + q) * numberOfRows + r] = dots[q];
+                }
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void dot_products_f32_avx2(const float* const* queries, int numberOfQueries, const float* const* rows, int numberOfRows, int size, float* out){
+    int block, tile, r, q, i, tileSize, blockEnd;
+    int vectorSize = size - size % 8;
+
+    for(block = 0; block < numberOfRows; block += DOT_ROW_BLOCK){
+        blockEnd = (block + DOT_ROW_BLOCK < numberOfRows) ? block + DOT_ROW_BLOCK : numberOfRows;
+        for(tile = 0; tile < numberOfQueries; tile += DOT_QUERY_TILE){
+            tileSize = (numberOfQueries - tile < DOT_QUERY_TILE) ? numberOfQueries - tile : DOT_QUERY_TILE;
+            const float* q0 = queries[tile];
+            const float* q1 = queries[tile + (tileSize > 1 ? 1 : 0)];
+            const float* q2 = queries[tile + (tileSize > 2 ? 2 : 0)];
+            const float* q3 = queries[tile + (tileSize > 3 ? 3 : 0)];
+            if(tileSize == 1){
+                for(r = block; r < blockEnd; r++){
+                    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+                    for(i = 0; i + 16 <= vectorSize; i += 16){
+                        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(rows[r] + i), _mm256_loadu_ps(q0 + i), sum0);
+                        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(rows[r] + i + 8), _mm256_loadu_ps(q0 + i + 8), sum1);
+                    }
+                    for(; i < vectorSize; i += 8){
+                        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(rows[r] + i), _mm256_loadu_ps(q0 + i), sum0);
+                    }
+                    float dot = horizontal_sum_avx2(_mm256_add_ps(sum0, sum1));
+                    for(i = vectorSize; i < size; i++) dot += q0[i] * rows[r][i];
+                    out[(size_t)tile * numberOfRows + r] = dot;
+                }
+                continue;
+            }
+            for(r = block; r < blockEnd; r++){
+                const float* row = rows[r];
+                __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+                __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+                for(i = 0; i < vectorSize; i += 8){
+                    __m256 x = _mm256_loadu_ps(row + i);
+                    sum0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q0 + i), sum0);
+                    sum1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q1 + i), sum1);
+                    sum2 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q2 + i), sum2);
+                    sum3 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q3 + i), sum3);
+                }
+                float dots[DOT_QUERY_TILE] = {horizontal_sum_avx2(sum0), horizontal_sum_avx2(sum1), horizontal_sum_avx2(sum2), horizontal_sum_avx2(sum3)};
+                for(q = 0; q < tileSize; q++){
+                    for(i = vectorSize; i < size; i++) dots[q] += queries[tile + q][i] * row[i];
+                    out[(size_t)(tile + q) * numberOfRows + r] = dots[q];
+                }
+            }
+        }
+    }
+}
+
+// Float queries (e.g. centroids) against uint8 rows, every row is widened once per tile
+__attribute__((target("avx2,fma")))
+static void dot_products_f32_u8_avx2(const float* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, float* out){
+    int block, tile, r, q, i, tileSize, blockEnd;
+    int vectorSize = size - size % 8;
+
+    for(block = 0; block < numberOfRows; block += DOT_ROW_BLOCK){
+        blockEnd = (block + DOT_ROW_BLOCK < numberOfRows) ? block + DOT_ROW_BLOCK : numberOfRows;
+        for(tile = 0; tile < numberOfQueries; tile += DOT_QUERY_TILE){
+            tileSize = (numberOfQueries - tile < DOT_QUERY_TILE) ? numberOfQueries - tile : DOT_QUERY_TILE;
+            const float* q0 = queries[tile];
+            const float* q1 = queries[tile + (tileSize > 1 ? 1 : 0)];
+            const float* q2 = queries[tile + (tileSize > 2 ? 2 : 0)];
+            const float* q3 = queries[tile + (tileSize > 3 ? 3 : 0)];
+            for(r = block; r < blockEnd; r++){
+                const unsigned char* row = rows[r];
+                __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+                __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+                for(i = 0; i < vectorSize; i += 8){
+                    __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + i))));
+                    sum0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q0 + i), sum0);
+                    if(tileSize > 1){ // Predictable, and it saves the work for lone queries
+                        sum1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q1 + i), sum1);
+                        sum2 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q2 + i), sum2);
+                        sum3 = _mm256_fmadd_ps(x, _mm256_loadu_ps(q3 + i), sum3);
+                    }
+                }
+                float dots[DOT_QUERY_TILE] = {horizontal_sum_avx2(sum0), horizontal_sum_avx2(sum1), horizontal_sum_avx2(sum2), horizontal_sum_avx2(sum3)};
+                for(q = 0; q < tileSize; q++){
+                    for(i = vectorSize; i < size; i++) dots[q] += queries[tile + q][i] * (float)row[i];
+                    out[(size_t)(tile + q) * numberOfRows + r] = dots[q];
+                }
+            }
+        }
+    }
+}
+
+static void matrix_vector_f32_scalar(const float* matrix, int numberOfRows, int size, const float* vector, float* out){
+    for(int r = 0; r < numberOfRows; r++){
+        const float* row = matrix + (size_t)r * size;
+        float sum = 0.0f;
+        for(int i = 0; i < size; i++) sum += row[i] * vector[i];
+        out[r] = sum;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void matrix_vector_f32_avx2(const float* matrix, int numberOfRows, int size, const float* vector, float* out){
+    int r, i;
+    int vectorSize = size - size % 8;
+
+    for(r = 0; r + MATRIX_ROW_TILE <= numberOfRows; r += MATRIX_ROW_TILE){
+        const float* row0 = matrix + (size_t)r * size;
+        const float* row1 = row0 + size;
+        const float* row2 = row1 + size;
+        const float* row3 = row2 + size;
+        __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+        for(i = 0; i < vectorSize; i += 8){
+            __m256 x = _mm256_loadu_ps(vector + i);
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(row0 + i), x, sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(row1 + i), x, sum1);
+            sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(row2 + i), x, sum2);
+            sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(row3 + i), x, sum3);
+        }
+        float dots[MATRIX_ROW_TILE] = {horizontal_sum_avx2(sum0), horizontal_sum_avx2(sum1), horizontal_sum_avx2(sum2), horizontal_sum_avx2(sum3)};
+        for(i = vectorSize; i < size; i++){
+            dots[0] += row0[i] * vector[i];
+            dots[1] += row1[i] * vector[i];
+            dots[2] += row2[i] * vector[i];
+            dots[3] += row3[i] * vector[i];
+        }
+        for(i = 0; i < MATRIX_ROW_TILE; i++) out[r + i] = dots[i];
+    }
+    for(; r < numberOfRows; r++){ // What is left over, one row at a time
+        const float* row = matrix + (size_t)r * size;
+        __m256 sum = _mm256_setzero_ps();
+        for(i = 0; i < vectorSize; i += 8){
+            sum = _mm256_fmadd_ps(_mm256_loadu_ps(row + i), _mm256_loadu_ps(vector + i), sum);
+        }
+        float dot = horizontal_sum_avx2(sum);
+        for(i = vectorSize; i < size; i++) dot += row[i] * vector[i];
+        out[r] = dot;
+    }
+}
+
+static int non_zero_coordinates_f32_scalar(const float* vector, int size, int* coordinates){
+    int count = 0;
+    for(int i = 0; i < size; i++){
+        coordinates[count] = i;
+        count += (vector[i] != 0.0f);
+    }
+    return count;
+}
+
+// The positions of the set bits of every 8 bit mask, one per byte, so that the non zero coordinates of eight floats can be
+// packed to the front with a single permute and no branches (which pixels are zero is anyone's guess)
+static uint64_t make_compress_entry(int mask){
+    uint64_t entry = 0;
+    int count = 0;
+    for(int bit = 0; bit < 8; bit++){
+        if(mask & (1 << bit)) entry |= (uint64_t)bit << (8 * count++);
+    }
+    return entry;
+}
+
+static const uint64_t* compress_table(){
+    static uint64_t table[256];
+    static bool filled = false;
+    if(!filled){
+        for(int mask = 0; mask < 256; mask++) table[mask] = make_compress_entry(mask);
+        filled = true;
+    }
+    return table;
+}
+
+static const uint64_t* CompressTable = compress_table();
+
+// Every step writes eight ints at count, which is never past i, so nothing is written beyond size
+__attribute__((target("avx2,popcnt")))
+static int non_zero_coordinates_f32_avx2(const float* vector, int size, int* coordinates){
+    int i, count = 0;
+    int vectorSize = size - size % 8;
+    __m256i positions = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i eight = _mm256_set1_epi32(8);
+
+    for(i = 0; i < vectorSize; i += 8){
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(vector + i), _mm256_setzero_ps(), _CMP_NEQ_UQ));
+        __m256i permutation = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(CompressTable + mask)));
+        _mm256_storeu_si256((__m256i*)(coordinates + count), _mm256_permutevar8x32_epi32(positions, permutation));
+        count += _mm_popcnt_u32((unsigned int)mask);
+        positions = _mm256_add_epi32(positions, eight);
+    }
+    for(; i < size; i++){
+        coordinates[count] = i;
+        count += (vector[i] != 0.0f);
+    }
+    return count;
+}
+
+static int equal_positions_i32_scalar(const int* values, int size, int value, int* positions){
+    int count = 0;
+    for(int i = 0; i < size; i++){
+        positions[count] = i;
+        count += (values[i] == value);
+    }
+    return count;
+}
+
+// Same packing as the non zero coordinates, eight compares at a time
+__attribute__((target("avx2,popcnt")))
+static int equal_positions_i32_avx2(const int* values, int size, int value, int* positions){
+    int i, count = 0;
+    int vectorSize = size - size % 8;
+    __m256i indexes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i eight = _mm256_set1_epi32(8);
+    const __m256i wanted = _mm256_set1_epi32(value);
+
+    for(i = 0; i < vectorSize; i += 8){
+        __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(values + i)), wanted);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(equal));
+        __m256i permutation = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(CompressTable + mask)));
+        _mm256_storeu_si256((__m256i*)(positions + count), _mm256_permutevar8x32_epi32(indexes, permutation));
+        count += _mm_popcnt_u32((unsigned int)mask);
+        indexes = _mm256_add_epi32(indexes, eight);
+    }
+    for(; i < size; i++){
+        positions[count] = i;
+        count += (values[i] == value);
+    }
+    return count;
+}
+
+static void sparse_matrix_vector_f32_scalar(const float* columns, int numberOfRows, int stride, const int* coordinates, int numberOfCoordinates, const float* vector, float* out){
+    for(int r = 0; r < numberOfRows; r++) out[r] = 0.0f;
+    for(int c = 0; c < numberOfCoordinates; c++){
+        const float* column = columns + (size_t)coordinates[c] * stride;
+        float x = vector[coordinates[c]];
+        for(int r = 0; r < numberOfRows; r++) out[r] += x * column[r];
+    }
+}
+
+// The sums of up to SPARSE_ROW_BLOCK rows stay in registers while every listed column is added to them, two columns at a
+// time into separate sums so that the additions don't wait on each other
+__attribute__((target("avx2,fma")))
+static void sparse_matrix_vector_f32_avx2(const float* columns, int numberOfRows, int stride, const int* coordinates, int numberOfCoordinates, const float* vector, float* out){
+    int block, c, r, groups;
+    int vectorRows = numberOfRows - numberOfRows % 8;
+
+    for(block = 0; block < vectorRows; block += SPARSE_ROW_BLOCK){
+        groups = ((vectorRows - block < SPARSE_ROW_BLOCK) ? vectorRows - block : SPARSE_ROW_BLOCK) / 8; // Eight rows each, 1 to 4
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps(), b2 = _mm256_setzero_ps(), b3 = _mm256_setzero_ps();
+        for(c = 0; c + 1 < numberOfCoordinates; c += 2){
+            const float* column0 = columns + (size_t)coordinates[c] * stride + block;
+            const float* column1 = columns + (size_t)coordinates[c + 1] * stride + block;
+            __m256 x0 = _mm256_set1_ps(vector[coordinates[c]]);
+            __m256 x1 = _mm256_set1_ps(vector[coordinates[c + 1]]);
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(column0), x0, a0);
+            b0 = _mm256_fmadd_ps(_mm256_loadu_ps(column1), x1, b0);
+            if(groups > 1){ // The same for every column, so it is always predicted right
+                a1 = _mm256_fmadd_ps(_mm256_loadu_ps(column0 + 8), x0, a1);
+                b1 = _mm256_fmadd_ps(_mm256_loadu_ps(column1 + 8), x1, b1);
+            }
+            if(groups > 2){
+                a2 = _mm256_fmadd_ps(_mm256_loadu_ps(column0 + 16), x0, a2);
+                b2 = _mm256_fmadd_ps(_mm256_loadu_ps(column1 + 16), x1, b2);
+            }
+            if(groups > 3){
+                a3 = _mm256_fmadd_ps(_mm256_loadu_ps(column0 + 24), x0, a3);
+                b3 = _mm256_fmadd_ps(_mm256_loadu_ps(column1 + 24), x1, b3);
+            }
+        }
+        if(c < numberOfCoordinates){
+            const float* column = columns + (size_t)coordinates[c] * stride + block;
+            __m256 x = _mm256_set1_ps(vector[coordinates[c]]);
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(column), x, a0);
+            if(groups > 1) a1 = _mm256_fmadd_ps(_mm256_loadu_ps(column + 8), x, a1);
+            if(groups > 2) a2 = _mm256_fmadd_ps(_mm256_loadu_ps(column + 16), x, a2);
+            if(groups > 3) a3 = _mm256_fmadd_ps(_mm256_loadu_ps(column + 24), x, a3);
+        }
+        _mm256_storeu_ps(out + block, _mm256_add_ps(a0, b0));
+        if(groups > 1) _mm256_storeu_ps(out + block + 8, _mm256_add_ps(a1, b1));
+        if(groups > 2) _mm256_storeu_ps(out + block + 16, _mm256_add_ps(a2, b2));
+        if(groups > 3) _mm256_storeu_ps(out + block + 24, _mm256_add_ps(a3, b3));
+    }
+    for(r = vectorRows; r < numberOfRows; r++){ // What is left over, one row at a time
+        float sum = 0.0f;
+        for(c = 0; c < numberOfCoordinates; c++) sum += vector[coordinates[c]] * columns[(size_t)coordinates[c] * stride + r];
+        out[r] = sum;
+    }
+}
+
+// ------------------------------------------------------------------------------ //
+// ---------------------------------- Dispatch ---------------------------------- //
+// ------------------------------------------------------------------------------ //
+
+typedef uint32_t (*SquaredL2U8Kernel)(const unsigned char*, const unsigned char*, int);
+typedef float (*SquaredL2F32U8Kernel)(const float*, const unsigned char*, int);
+typedef uint32_t (*BoundedSquaredL2U8Kernel)(const unsigned char*, const unsigned char*, int, uint32_t);
+typedef float (*BoundedSquaredL2F32U8Kernel)(const float*, const unsigned char*, int, float);
+typedef float (*BoundedSquaredL2F32Kernel)(const float*, const float*, int, float);
+typedef void (*DotProductsU8Kernel)(const unsigned char* const*, int, const unsigned char* const*, int, int, uint32_t*);
+typedef void (*DotProductsF32Kernel)(const float* const*, int, const float* const*, int, int, float*);
+typedef void (*DotProductsF32U8Kernel)(const float* const*, int, const unsigned char* const*, int, int, float*);
+typedef void (*MatrixVectorF32Kernel)(const float*, int, int, const float*, float*);
+typedef int (*NonZeroCoordinatesF32Kernel)(const float*, int, int*);
+typedef int (*EqualPositionsI32Kernel)(const int*, int, int, int*);
+typedef void (*SparseMatrixVectorF32Kernel)(const float*, int, int, const int*, int, const float*, float*);
+
+static KernelLevel detect_kernel_level(){
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return KERNELS_AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return KERNELS_AVX2;
+    if(__builtin_cpu_supports("sse2")) return KERNELS_SSE2;
+    return KERNELS_SCALAR;
+}
+
+static const KernelLevel Level = detect_kernel_level();
+
+SquaredL2F32Kernel squared_l2_f32_kernel(KernelLevel level){
+    if(level > Level) return nullptr;
+    switch(level){
+        case KERNELS_AVX512: return squared_l2_f32_avx512;
+        case KERNELS_AVX2: return squared_l2_f32_avx2;
+        case KERNELS_SSE2: return squared_l2_f32_sse2;
+        default: return squared_l2_f32_scalar;
+    }
+}
+
+SquaredL2F64Kernel squared_l2_f64_kernel(KernelLevel level){
+    if(level > Level) return nullptr;
+    switch(level){
+        case KERNELS_AVX512: return squared_l2_f64_avx512;
+        case KERNELS_AVX2: return squared_l2_f64_avx2;
+        case KERNELS_SSE2: return squared_l2_f64_sse2;
+        default: return squared_l2_f64_scalar;
+    }
+}
+
+// The uint8 kernels stop at AVX2, AVX-512F alone has no 16 bit multiply-add
+static const SquaredL2U8Kernel SquaredL2U8 = (Level >= KERNELS_AVX2) ? squared_l2_u8_avx2 : (Level >= KERNELS_SSE2) ? squared_l2_u8_sse2 : squared_l2_u8_scalar;
+static const SquaredL2F32U8Kernel SquaredL2F32U8 = (Level >= KERNELS_AVX2) ? squared_l2_f32_u8_avx2 : squared_l2_f32_u8_scalar;
+static const SquaredL2F32Kernel SquaredL2F32 = squared_l2_f32_kernel(Level);
+static const SquaredL2F64Kernel SquaredL2F64 = squared_l2_f64_kernel(Level);
+
+static const BoundedSquaredL2U8Kernel BoundedSquaredL2U8 = (Level >= KERNELS_AVX2) ? bounded_squared_l2_u8_avx2 :
+    (Level >= KERNELS_SSE2) ? bounded<uint32_t, unsigned char, unsigned char, squared_l2_u8_sse2> : bounded<uint32_t, unsigned char, unsigned char, squared_l2_u8_scalar>;
+static const BoundedSquaredL2F32U8Kernel BoundedSquaredL2F32U8 = (Level >= KERNELS_AVX2) ? bounded<float, float, unsigned char, squared_l2_f32_u8_avx2> :
+    bounded<float, float, unsigned char, squared_l2_f32_u8_scalar>;
+static const BoundedSquaredL2F32Kernel BoundedSquaredL2F32 = (Level >= KERNELS_AVX512) ? bounded<float, float, float, squared_l2_f32_avx512> :
+    (Level >= KERNELS_AVX2) ? bounded<float, float, float, squared_l2_f32_avx2> :
+    (Level >= KERNELS_SSE2) ? bounded<float, float, float, squared_l2_f32_sse2> : bounded<float, float, float, squared_l2_f32_scalar>;
+
+static const DotProductsU8Kernel DotProductsU8 = (Level >= KERNELS_AVX2) ? dot_products_u8_avx2 : dot_products_u8_scalar;
+static const DotProductsF32Kernel DotProductsF32 = (Level >= KERNELS_AVX2) ? dot_products_f32_avx2 : dot_products_f32_scalar;
+static const DotProductsF32U8Kernel DotProductsF32U8 = (Level >= KERNELS_AVX2) ? dot_products_f32_u8_avx2 : dot_products_f32_u8_scalar;
+static const MatrixVectorF32Kernel MatrixVectorF32 = (Level >= KERNELS_AVX2) ? matrix_vector_f32_avx2 : matrix_vector_f32_scalar;
+static const NonZeroCoordinatesF32Kernel NonZeroCoordinatesF32 = (Level >= KERNELS_AVX2) ? non_zero_coordinates_f32_avx2 : non_zero_coordinates_f32_scalar;
+static const EqualPositionsI32Kernel EqualPositionsI32 = (Level >= KERNELS_AVX2) ? equal_positions_i32_avx2 : equal_positions_i32_scalar;
+static const SparseMatrixVectorF32Kernel SparseMatrixVectorF32 = (Level >= KERNELS_AVX2) ? sparse_matrix_vector_f32_avx2 : sparse_matrix_vector_f32_scalar;
+
+uint32_t squared_l2_u8(const unsigned char* p1, const unsigned char* p2, int size){
+    return SquaredL2U8(p1, p2, size);
+}
+
+float squared_l2_f32_u8(const float* p1, const unsigned char* p2, int size){
+    return SquaredL2F32U8(p1, p2, size);
+}
+
+float squared_l2_f32(const float* p1, const float* p2, int size){
+    return SquaredL2F32(p1, p2, size);
+}
+
+double squared_l2_f64(const double* p1, const double* p2, int size){
+    return SquaredL2F64(p1, p2, size);
+}
+
+uint32_t bounded_squared_l2_u8(const unsigned char* p1, const unsigned char* p2, int size, uint32_t bound){
+    return BoundedSquaredL2U8(p1, p2, size, bound);
+}
+
+float bounded_squared_l2_f32_u8(const float* p1, const unsigned char* p2, int size, float bound){
+    return BoundedSquaredL2F32U8(p1, p2, size, bound);
+}
+
+float bounded_squared_l2_f32(const float* p1, const float* p2, int size, float bound){
+    return BoundedSquaredL2F32(p1, p2, size, bound);
+}
+
+void dot_products_u8(const unsigned char* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, uint32_t* out){
+    DotProductsU8(queries, numberOfQueries, rows, numberOfRows, size, out);
+}
+
+void dot_products_f32(const float* const* queries, int numberOfQueries, const float* const* rows, int numberOfRows, int size, float* out){
+    DotProductsF32(queries, numberOfQueries, rows, numberOfRows, size, out);
+}
+
+void dot_products_f32_u8(const float* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, float* out){
+    DotProductsF32U8(queries, numberOfQueries, rows, numberOfRows, size, out);
+}
+
+void matrix_vector_f32(const float* matrix, int numberOfRows, int size, const float* vector, float* out){
+    MatrixVectorF32(matrix, numberOfRows, size, vector, out);
+}
+
+int non_zero_coordinates_f32(const float* vector, int size, int* coordinates){
+    return NonZeroCoordinatesF32(vector, size, coordinates);
+}
+
+int equal_positions_i32(const int* values, int size, int value, int* positions){
+    return EqualPositionsI32(values, size, value, positions);
+}
+
+void sparse_matrix_vector_f32(const float* columns, int numberOfRows, int stride, const int* coordinates, int numberOfCoordinates, const float* vector, float* out){
+    SparseMatrixVectorF32(columns, numberOfRows, stride, coordinates, numberOfCoordinates, vector, out);
+}
+
+KernelLevel distance_kernels_level(){
+    return Level;
+}
+
+const char* kernel_level_name(KernelLevel level){
+    switch(level){
+        case KERNELS_AVX512: return "AVX-512";
+        case KERNELS_AVX2: return "AVX2";
+        case KERNELS_SSE2: return "SSE2";
+        default: return "Scalar";
+    }
+}
+
+const char* distance_kernels_instruction_set(){
+    return kernel_level_name(Level);
+}
@@ -0,0 +1,69 @@
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+#include <stdint.h>
+
+// Vectorized building blocks of the metrics. Every kernel has a scalar version and the fastest version
+// that the CPU supports is picked once, when the program starts
+
+#define DISTANCE_BLOCK 64 // The bounded kernels look at their partial sum once every this many coordinates
+#define DOT_QUERY_TILE 4 // Queries that share every row load in the dot product kernels
+#define DOT_ROW_BLOCK 64 // Rows that every tile of queries goes over before moving on
+
+enum KernelLevel{
+    KERNELS_SCALAR,
+    KERNELS_SSE2,
+    KERNELS_AVX2, // Together with FMA
+    KERNELS_AVX512 // AVX-512F
+};
+
+typedef float (*SquaredL2F32Kernel)(const float*, const float*, int);
+typedef double (*SquaredL2F64Kernel)(const double*, const double*, int);
+
+// Sum of the squared differences of two uint8 vectors, exact integer arithmetic
+uint32_t squared_l2_u8(const unsigned char* p1, const unsigned char* p2, int size);
+
+// Sum of the squared differences of a float vector and a uint8 vector
+float squared_l2_f32_u8(const float* p1, const unsigned char* p2, int size);
+
+// Sum of the squared differences of two float vectors
+float squared_l2_f32(const float* p1, const float* p2, int size);
+
+// Sum of the squared differences of two double vectors, for the ImageVector coordinates
+double squared_l2_f64(const double* p1, const double* p2, int size);
+
+// The same sums, but they may stop as soon as the partial sum goes over the bound. The result is exact when it is
+// not over the bound, otherwise it is only guaranteed to be over it
+uint32_t bounded_squared_l2_u8(const unsigned char* p1, const unsigned char* p2, int size, uint32_t bound);
+float bounded_squared_l2_f32_u8(const float* p1, const unsigned char* p2, int size, float bound);
+float bounded_squared_l2_f32(const float* p1, const float* p2, int size, float bound);
+
+// Every query against every row, out[q * numberOfRows + r] = <queries[q], rows[r]>. The uint8 version is exact
+// for any size below 33000 coordinates
+void dot_products_u8(const unsigned char* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, uint32_t* out);
+void dot_products_f32(const float* const* queries, int numberOfQueries, const float* const* rows, int numberOfRows, int size, float* out);
+void dot_products_f32_u8(const float* const* queries, int numberOfQueries, const unsigned char* const* rows, int numberOfRows, int size, float* out);
+
+// out[r] = <matrix row r, vector> for a row-major numberOfRows x size matrix, every load of the vector serves MATRIX_ROW_TILE rows
+#define MATRIX_ROW_TILE 4
+void matrix_vector_f32(const float* matrix, int numberOfRows, int size, const float* vector, float* out);
+
+// The same for a vector that is mostly zeros. coordinates gets the positions of the non zero ones, in order, and the count is returned
+int non_zero_coordinates_f32(const float* vector, int size, int* coordinates);
+// out[r] = sum of vector[c] * columns[c * stride + r] over the listed coordinates c, i.e. the matrix is stored column by column
+// and only the columns of the non zero coordinates are read. SPARSE_ROW_BLOCK sums are kept in registers at a time
+#define SPARSE_ROW_BLOCK 32
+void sparse_matrix_vector_f32(const float* columns, int numberOfRows, int stride, const int* coordinates, int numberOfCoordinates, const float* vector, float* out);
+
+// The positions i where values[i] == value, in order, and how many there are. positions needs room for size of them
+int equal_positions_i32(const int* values, int size, int value, int* positions);
+
+KernelLevel distance_kernels_level(); // What the CPU supports
+const char* distance_kernels_instruction_set(); // The name of the kernels that got picked, for the logs
+const char* kernel_level_name(KernelLevel level);
+
+// A specific version of the kernels, nullptr if the CPU does not support it. Only the benchmark should need these
+SquaredL2F32Kernel squared_l2_f32_kernel(KernelLevel level);
+SquaredL2F64Kernel squared_l2_f64_kernel(KernelLevel level);
+
+#endif
@@ -0,0 +1,134 @@
+#include "ground_truth.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+uint64_t file_content_hash(const std::string& filename){
+    uint64_t hash = FNV_OFFSET_BASIS;
+    unsigned char buffer[1 << 16];
+    size_t bytesRead, i;
+
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return 0;
+    while((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0){
+        for(i = 0; i < bytesRead; i++){
+            hash ^= buffer[i];
+            hash *= FNV_PRIME;
+        }
+    }
+    fclose(file);
+    return hash;
+}
+
+bool write_ground_truth(const std::string& filename, uint64_t datasetHash, uint64_t querysetHash, int k, const std::vector<std::vector<std::pair<double, int>>>& nearest){
+    GroundTruthHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = GROUND_TRUTH_MAGIC_NUMBER;
+    header.Version = GROUND_TRUTH_VERSION;
+    header.DatasetHash = datasetHash;
+    header.QuerysetHash = querysetHash;
+    header.NumberOfQueries = (int32_t)nearest.size();
+    header.K = k;
+
+    std::vector<int32_t> numbers((size_t)nearest.size() * k, -1);
+    std::vector<double> distances((size_t)nearest.size() * k, 0.0);
+    for(size_t q = 0; q < nearest.size(); q++){
+        for(int j = 0; j < k && j < (int)nearest[q].size(); j++){
+            numbers[q * k + j] = nearest[q][j].second;
+            distances[q * k + j] = nearest[q][j].first;
+        }
+    }
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if(file == NULL){
+        perror("Error opening ground truth file");
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(distances.data(), sizeof(double), distances.size(), file) == distances.size() &&
+        fwrite(numbers.data(), sizeof(int32_t), numbers.size(), file) == numbers.size();
+    if(fclose(file) != 0) written = false;
+    if(!written) printf("Error writing %s\n", filename.c_str());
+    return written;
+}
+
+GroundTruth::GroundTruth(const std::string& filename){
+    struct stat fileInfo;
+    size_t expectedSize;
+
+    this->FileDescriptor = -1;
+    this->MappingSize = 0;
+    this->Mapping = nullptr;
+    this->Numbers = nullptr;
+    this->Distances = nullptr;
+    memset(&this->Header, 0, sizeof(this->Header));
+
+    this->FileDescriptor = open(filename.c_str(), O_RDONLY);
+    if(this->FileDescriptor < 0){
+        perror("Error while opening ground truth file");
+        return;
+    }
+    if(fstat(this->FileDescriptor, &fileInfo) < 0 || (size_t)fileInfo.st_size < sizeof(GroundTruthHeader)){
+        printf("Error: %s is too small to hold the header\n", filename.c_str());
+        return;
+    }
+
+    void* mapping = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, this->FileDescriptor, 0);
+    if(mapping == MAP_FAILED){
+        perror("Error while mapping ground truth file");
+        return;
+    }
+    this->MappingSize = (size_t)fileInfo.st_size;
+    this->Mapping = static_cast<unsigned char*>(mapping);
+    memcpy(&this->Header, this->Mapping, sizeof(this->Header));
+
+    expectedSize = sizeof(GroundTruthHeader) + (size_t)std::max(0, this->Header.NumberOfQueries) * std::max(0, this->Header.K) * (sizeof(int32_t) + sizeof(double));
+    if(this->Header.Magic != GROUND_TRUTH_MAGIC_NUMBER || this->Header.Version != GROUND_TRUTH_VERSION || this->MappingSize != expectedSize){
+        printf("Error: %s is not a ground truth file of this version\n", filename.c_str());
+        munmap(this->Mapping, this->MappingSize);
+        this->Mapping = nullptr;
+        return;
+    }
+    this->Distances = (const double*)(this->Mapping + sizeof(GroundTruthHeader)); // The header is 32 bytes so the doubles stay aligned
+    this->Numbers = (const int32_t*)(this->Distances + (size_t)this->Header.NumberOfQueries * this->Header.K);
+}
+
+GroundTruth::~GroundTruth(){
+    if(this->Mapping != nullptr) munmap(this->Mapping, this->MappingSize);
+    if(this->FileDescriptor >= 0) close(this->FileDescriptor);
+}
+
+bool GroundTruth::is_open(){
+    return this->Mapping != nullptr;
+}
+
+bool GroundTruth::matches(uint64_t datasetHash, uint64_t querysetHash){
+    return is_open() && this->Header.DatasetHash == datasetHash && this->Header.QuerysetHash == querysetHash;
+}
+
+int GroundTruth::get_number_of_queries(){
+    return this->Header.NumberOfQueries;
+}
+
+int GroundTruth::get_k(){
+    return this->Header.K;
+}
+
+std::vector<std::pair<double, int>> GroundTruth::get_nearest(int query, int numberOfNearest){
+    std::vector<std::pair<double, int>> nearest;
+    size_t offset = (size_t)query * this->Header.K;
+
+    for(int j = 0; j < numberOfNearest && j < this->Header.K; j++){
+        if(this->Numbers[offset + j] < 0) break; // Padding
+        nearest.push_back(std::make_pair(this->Distances[offset + j], (int)this->Numbers[offset + j]));
+    }
+    return nearest;
+}
@@ -0,0 +1,49 @@
+#ifndef GROUND_TRUTH_H
+#define GROUND_TRUTH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The exact nearest neighbors of every query of a queryset, computed once by ./ground_truth and mapped by the drivers.
+// Little endian, a GroundTruthHeader followed by the distances double[queries][k] and then the image numbers
+// int32[queries][k], nearest first. A query with fewer than k neighbors is padded with number -1
+#define GROUND_TRUTH_MAGIC_NUMBER 0x48545247 // "GRTH"
+#define GROUND_TRUTH_VERSION 1
+
+struct GroundTruthHeader{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t DatasetHash; // file_content_hash of the files it was made from, a stale file is never used
+    uint64_t QuerysetHash;
+    int32_t NumberOfQueries;
+    int32_t K;
+};
+
+uint64_t file_content_hash(const std::string& filename); // FNV-1a of the whole file, 0 if it can't be read
+
+// <distance, image number> pairs of every query, in queryset order
+bool write_ground_truth(const std::string& filename, uint64_t datasetHash, uint64_t querysetHash, int k, const std::vector<std::vector<std::pair<double, int>>>& nearest);
+
+class GroundTruth{
+    int FileDescriptor;
+    size_t MappingSize;
+    unsigned char* Mapping;
+    GroundTruthHeader Header;
+    const int32_t* Numbers;
+    const double* Distances;
+
+    public:
+    GroundTruth(const std::string& filename);
+    ~GroundTruth();
+    GroundTruth(const GroundTruth&) = delete;
+    GroundTruth& operator=(const GroundTruth&) = delete;
+
+    bool is_open();
+    bool matches(uint64_t datasetHash, uint64_t querysetHash); // Made from exactly these files
+    int get_number_of_queries();
+    int get_k();
+    std::vector<std::pair<double, int>> get_nearest(int query, int numberOfNearest); // <distance, image number>, at most get_k()
+};
+
+#endif
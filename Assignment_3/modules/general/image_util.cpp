@@ -1,16 +1,117 @@
 #include "image_util.h"
+#include "dataset_store.h"
+#include "thread_pool.h"
+#include "top_k.h"
 
-// The dataset is fine but then the index of the queryset is wrong, it starts from 60000 but reduced[60000] is out of bounds for the queryset
-SpaceCorrespondace::SpaceCorrespondace(std::vector<std::shared_ptr<ImageVector>> initial){
-    int number;
+#include <algorithm>
 
-    for(auto& element : initial){
-        number = element->get_number();
-        InitialSpace[number] = element;
+// The dataset is fine but then the index of the queryset is wrong, it starts from 60000 but reduced[60000] is out of bounds for the queryset.
+// So the table goes by number and anything outside of it is simply not there
+SpaceCorrespondace::SpaceCorrespondace(std::shared_ptr<DatasetStore> initial){
+    int row, number, lastNumber;
+
+    this->InitialSpace = initial;
+    this->FirstNumber = 0;
+    if(initial->size() == 0) return;
+
+    this->FirstNumber = lastNumber = initial->get_number(0);
+    for(row = 1; row < initial->size(); row++){
+        number = initial->get_number(row);
+        this->FirstNumber = std::min(this->FirstNumber, number);
+        lastNumber = std::max(lastNumber, number);
+    }
+    this->InitialRows.assign(lastNumber - this->FirstNumber + 1, -1);
+    for(row = 0; row < initial->size(); row++){
+        this->InitialRows[initial->get_number(row) - this->FirstNumber] = row;
     }
 }
+
+SpaceCorrespondace::SpaceCorrespondace(const std::vector<std::shared_ptr<ImageVector>>& initial)
+    : SpaceCorrespondace(std::make_shared<DatasetStore>(initial, STORE_UINT8)){} // Falls back to floats by itself if they are not pixels
+
+int SpaceCorrespondace::get_initial_row(int number){
+    number -= this->FirstNumber;
+    return (number >= 0 && number < (int)this->InitialRows.size()) ? this->InitialRows[number] : -1;
+}
+
 std::shared_ptr<ImageVector> SpaceCorrespondace::get_initial(int number){
-    return InitialSpace[number];
+    int row = get_initial_row(number);
+    return (row < 0) ? nullptr : this->InitialSpace->get_image(row);
+}
+
+std::vector<std::pair<double, int>> SpaceCorrespondace::rerank_rows(
+    const StoreQuery& originalQuery,
+    const std::vector<std::pair<double, std::shared_ptr<ImageVector>>>& reducedCandidates,
+    int numberOfNearest,
+    Metric* metric){
+
+    std::vector<int> candidateNumbers;
+    candidateNumbers.reserve(reducedCandidates.size());
+    for(auto& candidate : reducedCandidates){
+        candidateNumbers.push_back(candidate.second->get_number());
+    }
+    return rerank_rows(originalQuery, candidateNumbers, numberOfNearest, metric);
+}
+
+std::vector<std::pair<double, int>> SpaceCorrespondace::rerank_rows(
+    const StoreQuery& originalQuery,
+    const std::vector<int>& candidateNumbers,
+    int numberOfNearest,
+    Metric* metric){
+
+    int i, row;
+    std::vector<int> rows;
+
+    rows.reserve(candidateNumbers.size());
+    for(auto& number : candidateNumbers){
+        if(number == originalQuery.Number) continue; // The graphs do find the query itself
+        row = get_initial_row(number);
+        if(row >= 0) rows.push_back(row);
+    }
+
+    // One pass over all of them instead of a distance at a time
+    std::vector<double> distances(rows.size());
+    std::vector<const StoreQuery*> queries(1, &originalQuery);
+    this->InitialSpace->comparison_distances(queries, rows.data(), (int)rows.size(), metric, distances.data());
+
+    TopK nearest(numberOfNearest);
+    if(this->InitialSpace->exact_comparison_distances(originalQuery, metric)){
+        for(i = 0; i < (int)rows.size(); i++){
+            nearest.push(distances[i], rows[i]);
+        }
+        return nearest.to_distance_pairs(metric);
+    }
+
+    // The float dot products are only good for throwing candidates out. Whatever could still make it is scored exactly,
+    // so that the distances we hand back are the real ones
+    for(i = 0; i < (int)rows.size(); i++){
+        if(distances[i] - this->InitialSpace->comparison_distances_error(originalQuery, rows[i]) <= nearest.bound()){
+            nearest.push(this->InitialSpace->comparison_distance(originalQuery, rows[i], metric), rows[i]);
+        }
+    }
+    return nearest.to_distance_pairs(metric);
+}
+
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> SpaceCorrespondace::rerank(
+    const StoreQuery& originalQuery,
+    const std::vector<std::pair<double, std::shared_ptr<ImageVector>>>& reducedCandidates,
+    int numberOfNearest,
+    Metric* metric){
+
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
+    for(auto& pair : rerank_rows(originalQuery, reducedCandidates, numberOfNearest, metric)){
+        nearestImages.push_back(std::make_pair(pair.first, this->InitialSpace->get_image(pair.second)));
+    }
+    return nearestImages;
+}
+
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> SpaceCorrespondace::rerank(
+    const std::shared_ptr<ImageVector>& originalQuery,
+    const std::vector<std::pair<double, std::shared_ptr<ImageVector>>>& reducedCandidates,
+    int numberOfNearest,
+    Metric* metric){
+
+    return rerank(this->InitialSpace->make_query(originalQuery), reducedCandidates, numberOfNearest, metric);
 }
 
 ImageVector::ImageVector(int number, std::vector<double> coordinates){
@@ -35,87 +136,154 @@ bool ImageVector::operator==(const ImageVector& other) const{
     return Coordinates == other.Coordinates;
 }
 
-std::vector<std::pair<double, int>> exhaustive_nearest_neighbor_search(
-    std::vector<std::shared_ptr<ImageVector>> images, 
-    std::shared_ptr<ImageVector> image, 
+// How many pieces a scan of the whole store gets split into, at most one per thread
+static int number_of_scan_tasks(const std::shared_ptr<DatasetStore>& store){
+    int byRows = (store->size() + EXHAUSTIVE_ROWS_PER_TASK - 1) / EXHAUSTIVE_ROWS_PER_TASK;
+    return std::max(1, std::min(search_thread_pool().size(), byRows));
+}
+
+// Adds the rows begin to end - 1 to the k nearest, by comparison distance
+static void nearest_in_rows(
+    const std::shared_ptr<DatasetStore>& store,
+    const StoreQuery& query,
+    const SearchKernels& kernels,
+    int begin, int end,
+    TopK& nearest){
+
+    int row;
+
+    for(row = begin; row < end; row++){
+        if(store->get_number(row) != query.Number){ // Ignore comparing it to itself
+            // Anything farther than the current k-th best can be given up on halfway through
+            nearest.push(store->bounded_comparison_distance(query, row, kernels, nearest.bound()), row);
+        }
+    }
+}
+
+std::vector<std::pair<double, int>> exhaustive_nearest_neighbor_search_return_rows(
+    const std::shared_ptr<DatasetStore>& store, 
+    const StoreQuery& query, 
     int numberOfNearest,
     Metric* metric){
 
-    int i;
-    double distance;
+    SearchKernels kernels = store->search_kernels(metric); // Once per search, not once per row
+    int numberOfTasks = number_of_scan_tasks(store);
+    int rowsPerTask = (store->size() + numberOfTasks - 1) / numberOfTasks;
 
-    // I will be using a priority queue again
-    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::less<std::pair<double, int>>> nearest;
+    // Every thread keeps its own k best of its part of the store, they get merged at the end
+    std::vector<TopK> taskNearest(numberOfTasks, TopK(numberOfNearest));
+    search_thread_pool().parallel_for(numberOfTasks, [&](int task){
+        int begin = task * rowsPerTask;
+        int end = std::min(store->size(), begin + rowsPerTask);
+        nearest_in_rows(store, query, kernels, begin, end, taskNearest[task]);
+    });
 
-    std::vector<std::pair<double, int>> nearestImages;
+    for(int task = 1; task < numberOfTasks; task++){
+        taskNearest[0].merge(taskNearest[task]);
+    }
+    return taskNearest[0].to_distance_pairs(metric);
+}
+
+std::vector<std::vector<std::pair<double, int>>> exhaustive_nearest_neighbor_search_batch(
+    const std::shared_ptr<DatasetStore>& store, 
+    const std::vector<StoreQuery>& queries, 
+    int numberOfNearest,
+    Metric* metric){
 
-    for(i = 0; i < (int)(images.size()); i++){
-        if(images[i] != image){ // Ignore comparing it to itself
-            distance = metric->calculate_distance(image->get_coordinates(), images[i]->get_coordinates());
-            nearest.push(std::make_pair(distance, images[i]->get_number()));
-            if ((int)(nearest.size()) > numberOfNearest){
-                nearest.pop();
+    int numberOfQueries = (int)queries.size();
+    int numberOfTasks = (numberOfQueries + EXHAUSTIVE_BATCH_QUERIES - 1) / EXHAUSTIVE_BATCH_QUERIES;
+    std::vector<TopK> nearest(numberOfQueries, TopK(numberOfNearest));
+
+    SearchKernels kernels = store->search_kernels(metric);
+
+    // Same scan as the single query search with the loops swapped: every block of rows is scanned by all the queries
+    // of a task while it is still in cache, and each query keeps its own k-th best as the bound
+    search_thread_pool().parallel_for(numberOfTasks, [&](int task){
+        int q, block, blockEnd;
+        int firstQuery = task * EXHAUSTIVE_BATCH_QUERIES;
+        int lastQuery = std::min(numberOfQueries, firstQuery + EXHAUSTIVE_BATCH_QUERIES);
+
+        for(block = 0; block < store->size(); block += EXHAUSTIVE_BATCH_ROWS){
+            blockEnd = std::min(store->size(), block + EXHAUSTIVE_BATCH_ROWS);
+            for(q = firstQuery; q < lastQuery; q++){
+                nearest_in_rows(store, queries[q], kernels, block, blockEnd, nearest[q]);
             }
         }
+    });
+
+    std::vector<std::vector<std::pair<double, int>>> nearestRows(numberOfQueries);
+    for(int q = 0; q < numberOfQueries; q++){
+        nearestRows[q] = nearest[q].to_distance_pairs(metric);
     }
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
+    return nearestRows;
+}
+
+std::vector<std::pair<double, int>> exhaustive_nearest_neighbor_search(
+    const std::shared_ptr<DatasetStore>& store, 
+    const std::shared_ptr<ImageVector>& image, 
+    int numberOfNearest,
+    Metric* metric){
+
+    StoreQuery query = store->make_query(image);
+    std::vector<std::pair<double, int>> nearest = exhaustive_nearest_neighbor_search_return_rows(store, query, numberOfNearest, metric);
+
+    for(auto& pair : nearest){
+        pair.second = store->get_number(pair.second); // Rows to image numbers
     }
-    std::vector<std::pair<double,int>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
+    return nearest;
 }
 
 std::vector<std::pair<double, std::shared_ptr<ImageVector>>> exhaustive_nearest_neighbor_search_return_images(
-    std::vector<std::shared_ptr<ImageVector>> images, 
-    std::shared_ptr<ImageVector> image, 
+    const std::shared_ptr<DatasetStore>& store, 
+    const std::shared_ptr<ImageVector>& image, 
     int numberOfNearest,
     Metric* metric){
 
-    int i;
-    double distance;
-
-    // I will be using a priority queue again
-    std::priority_queue<std::pair<double, std::shared_ptr<ImageVector>>, std::vector<std::pair<double, std::shared_ptr<ImageVector>>>, std::less<std::pair<double, std::shared_ptr<ImageVector>>>> nearest;
+    StoreQuery query = store->make_query(image);
+    std::vector<std::pair<double, int>> nearest = exhaustive_nearest_neighbor_search_return_rows(store, query, numberOfNearest, metric);
 
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
-
-    for(i = 0; i < (int)(images.size()); i++){
-        if(images[i] != image){ // Ignore comparing it to itself
-            distance = metric->calculate_distance(image->get_coordinates(), images[i]->get_coordinates());
-            nearest.push(std::make_pair(distance, images[i]));
-            if ((int)(nearest.size()) > numberOfNearest){
-                nearest.pop();
-            }
-        }
-    }
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
+    for(auto& pair : nearest){
+        nearestImages.push_back(std::make_pair(pair.first, store->get_image(pair.second))); // After the threads are done, get_image isn't thread safe
     }
-    std::vector<std::pair<double,std::shared_ptr<ImageVector>>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
+    return nearestImages;
 }
 
 
 std::vector<std::pair<double, std::shared_ptr<ImageVector>>> exhaustive_range_search(
-    std::vector<std::shared_ptr<ImageVector>> images, 
-    std::shared_ptr<ImageVector> image, 
+    const std::shared_ptr<DatasetStore>& store, 
+    const std::shared_ptr<ImageVector>& image, 
     double r,
     Metric* metric){
-        int i;
-        double distance;
+        StoreQuery query = store->make_query(image);
+        SearchKernels kernels = store->search_kernels(metric);
+        double comparisonRadius = metric->to_comparison_distance(r);
+        int numberOfTasks = number_of_scan_tasks(store);
+        int rowsPerTask = (store->size() + numberOfTasks - 1) / numberOfTasks;
+
+        // <comparison distance, row> of every part, in row order
+        std::vector<std::vector<std::pair<double, int>>> taskInRange(numberOfTasks);
+        search_thread_pool().parallel_for(numberOfTasks, [&](int task){
+            int row;
+            double distance;
+            int begin = task * rowsPerTask;
+            int end = std::min(store->size(), begin + rowsPerTask);
+            for(row = begin; row < end; row++){
+                if(store->get_number(row) != query.Number){ // Ignore comparing to itself
+                    distance = store->bounded_comparison_distance(query, row, kernels, comparisonRadius);
+                    if(distance <= comparisonRadius){
+                        taskInRange[task].push_back(std::make_pair(distance, row));
+                    }
+                }
+            }
+        });
 
         // The returned vector
         std::vector<std::pair<double, std::shared_ptr<ImageVector>>> inRangeImages;
-
-        for(i = 0; i < (int)(images.size()); i++){
-            if(images[i]->get_number() != image->get_number()){ // Ignore comparing to itself
-                distance = metric->calculate_distance(image->get_coordinates(), images[i]->get_coordinates());
-                if(distance <= r){
-                    inRangeImages.push_back(std::make_pair(distance, images[i]));
-                }
+        for(auto& inRange : taskInRange){
+            for(auto& pair : inRange){
+                inRangeImages.push_back(std::make_pair(metric->to_distance(pair.first), store->get_image(pair.second)));
             }
         }
     return inRangeImages;
-    }
\ No newline at end of file
+    }
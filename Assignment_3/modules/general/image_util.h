@@ -5,6 +5,7 @@
 #include <memory>
 #include <queue>
 #include <map>
+#include <cfloat>
 
 #include "metrics.h"
 
@@ -21,17 +22,45 @@ class ImageVector{
     bool operator==(const ImageVector& other) const;
 };
 
-std::vector<std::pair<double, int>> exhaustive_nearest_neighbor_search(std::vector<std::shared_ptr<ImageVector>> images, std::shared_ptr<ImageVector> image, int numberOfNearest,Metric* metric);
-std::vector<std::pair<double, std::shared_ptr<ImageVector>>> exhaustive_nearest_neighbor_search_return_images(std::vector<std::shared_ptr<ImageVector>> images, std::shared_ptr<ImageVector> image, int numberOfNearest, Metric* metric);
-std::vector<std::pair<double, std::shared_ptr<ImageVector>>> exhaustive_range_search(std::vector<std::shared_ptr<ImageVector>> images, std::shared_ptr<ImageVector> image, double r, Metric* metric);
+class DatasetStore; // dataset_store.h includes this header
+class StoreQuery;
 
+#define EXHAUSTIVE_ROWS_PER_TASK 4096 // Smaller pieces of the store are not worth handing to another thread
+
+// The exhaustive searches ignore the query itself when it is part of the store. They split the store over
+// search_thread_pool() and only turn rows into images once the threads are done
+std::vector<std::pair<double, int>> exhaustive_nearest_neighbor_search_return_rows(const std::shared_ptr<DatasetStore>& store, const StoreQuery& query, int numberOfNearest, Metric* metric); // <distance, row> pairs
+std::vector<std::pair<double, int>> exhaustive_nearest_neighbor_search(const std::shared_ptr<DatasetStore>& store, const std::shared_ptr<ImageVector>& image, int numberOfNearest, Metric* metric);
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> exhaustive_nearest_neighbor_search_return_images(const std::shared_ptr<DatasetStore>& store, const std::shared_ptr<ImageVector>& image, int numberOfNearest, Metric* metric);
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> exhaustive_range_search(const std::shared_ptr<DatasetStore>& store, const std::shared_ptr<ImageVector>& image, double r, Metric* metric);
+
+#define EXHAUSTIVE_BATCH_QUERIES 64 // Queries that share every block of rows, and what every thread gets
+#define EXHAUSTIVE_BATCH_ROWS 1024 // Rows per block, small enough to stay in cache while all the queries go over it
+
+// The k nearest rows of many queries at once, same results as exhaustive_nearest_neighbor_search_return_rows for each one.
+// Every block of rows is read from memory once per EXHAUSTIVE_BATCH_QUERIES queries instead of once per query
+std::vector<std::vector<std::pair<double, int>>> exhaustive_nearest_neighbor_search_batch(const std::shared_ptr<DatasetStore>& store, const std::vector<StoreQuery>& queries, int numberOfNearest, Metric* metric);
+
+// Takes the images of a reduced space back to the original one. The reduced images keep the numbers of their original
+// images, so a table indexed by number finds the original row with a single lookup
 class SpaceCorrespondace{
-    std::vector<int> Indexes;
-    std::map<int, std::shared_ptr<ImageVector>> InitialSpace;
+    std::shared_ptr<DatasetStore> InitialSpace;
+    int FirstNumber;
+    std::vector<int> InitialRows; // Number - FirstNumber -> row of InitialSpace, -1 where there is no such image
 
     public:
-    SpaceCorrespondace(std::vector<std::shared_ptr<ImageVector>> initial);
-    std::shared_ptr<ImageVector> get_initial(int number);
+    SpaceCorrespondace(std::shared_ptr<DatasetStore> initial);
+    SpaceCorrespondace(const std::vector<std::shared_ptr<ImageVector>>& initial); // Packs them into a store of its own, get_initial still hands back these pointers
+    int get_initial_row(int number); // -1 if the original space has no image with this number
+    std::shared_ptr<ImageVector> get_initial(int number); // nullptr if the original space has no image with this number
+
+    // The numberOfNearest of the candidates a reduced space search found that are nearest to the query in the original space,
+    // <distance, original image> pairs nearest first. All the candidates are scored with one DatasetStore::comparison_distances
+    // call, and when that used float dot products the ones that could be among the nearest again one by one. The query has to be made by the original store, and like in the searches it is never its own neighbor
+    std::vector<std::pair<double, int>> rerank_rows(const StoreQuery& originalQuery, const std::vector<std::pair<double, std::shared_ptr<ImageVector>>>& reducedCandidates, int numberOfNearest, Metric* metric); // <distance, original row>
+    std::vector<std::pair<double, int>> rerank_rows(const StoreQuery& originalQuery, const std::vector<int>& candidateNumbers, int numberOfNearest, Metric* metric); // Just the image numbers of the candidates
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> rerank(const StoreQuery& originalQuery, const std::vector<std::pair<double, std::shared_ptr<ImageVector>>>& reducedCandidates, int numberOfNearest, Metric* metric);
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> rerank(const std::shared_ptr<ImageVector>& originalQuery, const std::vector<std::pair<double, std::shared_ptr<ImageVector>>>& reducedCandidates, int numberOfNearest, Metric* metric);
 };
 
 #endif
\ No newline at end of file
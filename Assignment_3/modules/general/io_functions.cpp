@@ -1,4 +1,6 @@
 #include "io_functions.h" // includes <iostream>, <fstream>, and <vector>
+#include <cstring>
+#include <algorithm>
 
 
 HeaderInfo::HeaderInfo(int32_t numberOfImages, int32_t numberOfRows, int32_t numberOfColumns){
@@ -21,83 +23,115 @@ bool HeaderInfo::operator==(const HeaderInfo& other) const{
     return (numberOfRows == other.numberOfRows) && (numberOfColumns == other.numberOfColumns);
 }
 
-// Need to make this work with the new ImageVector class
-std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> read_mnist_images(const std::string& filename, int imagesAlreadyRead){ // Need this so as the image numbers do not overlap
+MappedImages::MappedImages(const std::string& filename){
+    struct stat fileInfo;
+    uint32_t header[4];
     bool littleEndian = false;
-    
-    int imageNumberCounter = imagesAlreadyRead + 1;
-    std::shared_ptr<ImageVector> image;
 
-    std::ifstream file(filename, std::ios::binary);
-    std::vector<std::shared_ptr<ImageVector>> allImages;
-    std::shared_ptr<HeaderInfo> headerInfo;
+    this->FileDescriptor = -1;
+    this->MappingSize = 0;
+    this->Mapping = nullptr;
+    this->NumberOfImages = 0;
+    this->NumberOfPixels = 0;
 
-    if(!file.is_open()){
+    this->FileDescriptor = open(filename.c_str(), O_RDONLY);
+    if(this->FileDescriptor < 0){
         perror("Error while opening file");
-        return {headerInfo, allImages}; // Return an empty vector in case of an error
+        return;
     }
-
-    // Skip the header information (4 bytes)
-    uint32_t magicNumber;
-    file.read(reinterpret_cast<char*>(&magicNumber), sizeof(magicNumber));
-
-    if(magicNumber == 7){
-        littleEndian = true;
+    if(fstat(this->FileDescriptor, &fileInfo) < 0 || fileInfo.st_size < MNIST_HEADER_SIZE){
+        printf("Error: %s is too small to hold the header\n", filename.c_str());
+        return;
     }
+    this->MappingSize = (size_t)fileInfo.st_size;
 
-    // Read the number of images
-    uint32_t numberOfImages;
-    file.read(reinterpret_cast<char*>(&numberOfImages), sizeof(numberOfImages));
-
-    if(!littleEndian) numberOfImages = ntohl(numberOfImages);  // Convert to little endian if need be 
+    void* mapping = mmap(nullptr, this->MappingSize, PROT_READ, MAP_PRIVATE, this->FileDescriptor, 0);
+    if(mapping == MAP_FAILED){
+        perror("Error while mapping file");
+        this->MappingSize = 0;
+        return;
+    }
+    this->Mapping = static_cast<unsigned char*>(mapping);
+    madvise(this->Mapping, this->MappingSize, MADV_SEQUENTIAL); // Every index build walks the file front to back
 
-    // printf("Number of images: %d\n", numberOfImages);
+    // The header is 4 uint32 values: magic number, number of images, number of rows, number of columns
+    memcpy(header, this->Mapping, sizeof(header));
 
-    // Read the number of rows
-    uint32_t numberOfRows;
-    file.read(reinterpret_cast<char*>(&numberOfRows), sizeof(numberOfRows));
+    if(header[0] == ENCODED_MAGIC_NUMBER){
+        littleEndian = true;
+    }
+    else if(ntohl(header[0]) != MNIST_MAGIC_NUMBER){
+        printf("Error: %s has an unknown magic number\n", filename.c_str());
+        munmap(this->Mapping, this->MappingSize);
+        this->Mapping = nullptr;
+        return;
+    }
+    for(int i = 1; i < 4; i++){
+        if(!littleEndian) header[i] = ntohl(header[i]); // Convert to little endian if need be
+    }
 
-    if(!littleEndian) numberOfRows = ntohl(numberOfRows); 
+    this->Header = std::make_shared<HeaderInfo>(header[1], header[2], header[3]);
+    this->NumberOfPixels = (int)(header[2] * header[3]);
 
-    // printf("Number of rows: %d\n", numberOfRows);
+    // Only expose the images that are actually in the file, the driver programs warn about the mismatch with the header
+    size_t imagesInFile = (this->NumberOfPixels > 0) ? (this->MappingSize - MNIST_HEADER_SIZE) / this->NumberOfPixels : 0;
+    this->NumberOfImages = (int)std::min(imagesInFile, (size_t)header[1]);
+}
 
-    // Read the number of columns
-    uint32_t numberOfColumns;
-    file.read(reinterpret_cast<char*>(&numberOfColumns), sizeof(numberOfColumns));
+MappedImages::~MappedImages(){
+    if(this->Mapping != nullptr){
+        munmap(this->Mapping, this->MappingSize);
+    }
+    if(this->FileDescriptor >= 0){
+        close(this->FileDescriptor);
+    }
+}
 
-    if(!littleEndian) numberOfColumns = ntohl(numberOfColumns); 
+bool MappedImages::is_open(){
+    return this->Mapping != nullptr;
+}
+std::shared_ptr<HeaderInfo> MappedImages::get_header_info(){
+    return this->Header;
+}
+int MappedImages::get_number_of_images(){
+    return this->NumberOfImages;
+}
+int MappedImages::get_number_of_pixels(){
+    return this->NumberOfPixels;
+}
+const unsigned char* MappedImages::get_image(int index){
+    return this->Mapping + MNIST_HEADER_SIZE + (size_t)index * this->NumberOfPixels;
+}
 
-    // printf("Number of columns: %d\n", numberOfColumns);
+std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> read_mnist_images(const std::string& filename, int imagesAlreadyRead){ // Need this so as the image numbers do not overlap
+    int imageNumberCounter = imagesAlreadyRead + 1;
+    std::shared_ptr<ImageVector> image;
+    std::vector<std::shared_ptr<ImageVector>> allImages;
 
-    headerInfo = std::make_shared<HeaderInfo>(numberOfImages, numberOfRows, numberOfColumns);
+    MappedImages mapped(filename);
+    if(!mapped.is_open()){
+        return {mapped.get_header_info(), allImages}; // Return an empty vector in case of an error
+    }
 
-    int numberOfPixels = numberOfRows * numberOfColumns;
+    int numberOfPixels = mapped.get_number_of_pixels();
 
-    // Define a vector to store the pixel values for one image
-    std::vector<unsigned char> imagePixels(numberOfPixels);
-    
     printf("Reading images... ");
 
-    // Read and process each image entry
-    while(file.read(reinterpret_cast<char*>(imagePixels.data()), numberOfPixels)){
-        // Convert pixel values from unsigned char to double and normalize
-        std::vector<double> normalizedPixels(numberOfPixels);
-        for (int i = 0; i < numberOfPixels; i++){
-            normalizedPixels[i] = static_cast<double>(imagePixels[i]); // Lets not normalize the pixels?
-        }
+    allImages.reserve(mapped.get_number_of_images());
+    for(int n = 0; n < mapped.get_number_of_images(); n++){
+        const unsigned char* imagePixels = mapped.get_image(n);
+
+        // Convert pixel values from unsigned char to double
+        std::vector<double> normalizedPixels(imagePixels, imagePixels + numberOfPixels); // Lets not normalize the pixels?
 
         image = std::make_shared<ImageVector>(imageNumberCounter, normalizedPixels); // Ended up using smart pointers cause having to keep in mind to free that memory is not very good practice
         imageNumberCounter++;
 
-        // Store the normalized pixel values in the container for all images
         allImages.push_back(image);
     }
 
-    // Close the dataset file
-    file.close();
-
     printf("Done\n");
-    return {headerInfo, allImages};
+    return {mapped.get_header_info(), allImages};
 }
 
 void write_results(
@@ -6,6 +6,10 @@
 #include <memory>
 #include <cfloat>
 #include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "image_util.h"
 
@@ -22,6 +26,32 @@ class HeaderInfo{
     bool operator==(const HeaderInfo& other) const;
 };
 
+#define MNIST_HEADER_SIZE 16
+#define MNIST_MAGIC_NUMBER 2051 // Big endian magic of the original MNIST image files
+#define ENCODED_MAGIC_NUMBER 7 // Little endian magic that reduce.py writes
+
+// Read-only memory mapping of an MNIST-format file, the pixels are never copied out of the mapping
+class MappedImages{
+    int FileDescriptor;
+    size_t MappingSize;
+    unsigned char* Mapping;
+    int NumberOfImages;
+    int NumberOfPixels;
+    std::shared_ptr<HeaderInfo> Header;
+
+    public:
+    MappedImages(const std::string& filename);
+    ~MappedImages();
+    MappedImages(const MappedImages&) = delete;
+    MappedImages& operator=(const MappedImages&) = delete;
+
+    bool is_open();
+    std::shared_ptr<HeaderInfo> get_header_info();
+    int get_number_of_images();
+    int get_number_of_pixels();
+    const unsigned char* get_image(int index); // A view straight into the mapping, valid for as long as the object lives
+};
+
 std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> read_mnist_images(const std::string& filename, int imagesAlreadyRead);
 void write_results(
     int datasetSize,std::shared_ptr<ImageVector> query, std::vector<std::pair<double, 
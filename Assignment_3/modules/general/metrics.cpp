@@ -1,14 +1,66 @@
 #include "metrics.h"
+#include "distance_kernels.h"
+
+#include <cfloat>
 
 double Eucledean::calculate_distance(const std::vector<double>& p1, const std::vector<double>& p2){ // Eucledean distance function between two points in vector form
-    double sum = 0.0;
+    return std::sqrt(comparison_distance(p1, p2));
+}
+
+double Eucledean::calculate_distance(const float* p1, const float* p2, int size){
+    return std::sqrt(comparison_distance(p1, p2, size));
+}
+
+double Eucledean::calculate_distance(const unsigned char* p1, const unsigned char* p2, int size){
+    return std::sqrt(comparison_distance(p1, p2, size));
+}
+
+double Eucledean::calculate_distance(const float* p1, const unsigned char* p2, int size){
+    return std::sqrt(comparison_distance(p1, p2, size));
+}
+
+double Eucledean::comparison_distance(const std::vector<double>& p1, const std::vector<double>& p2){
     int size;
 
     if(p1.size() > p2.size()) size = p2.size();  // If the vectors are not equal, calculate the distance in regards to their common length
     else size = p1.size();
 
-    for(int i = 0; i < size; i++){
-        sum += std::pow(p1[i] - p2[i], 2);
-    }
-    return std::sqrt(sum);
+    return squared_l2_f64(p1.data(), p2.data(), size);
+}
+
+double Eucledean::comparison_distance(const float* p1, const float* p2, int size){
+    return (double)squared_l2_f32(p1, p2, size);
+}
+
+double Eucledean::comparison_distance(const unsigned char* p1, const unsigned char* p2, int size){
+    return (double)squared_l2_u8(p1, p2, size);
+}
+
+double Eucledean::comparison_distance(const float* p1, const unsigned char* p2, int size){
+    return (double)squared_l2_f32_u8(p1, p2, size);
+}
+
+// The bound is clamped into the range of the kernel's type, the caller still compares the result with the original one
+double Eucledean::bounded_comparison_distance(const float* p1, const float* p2, int size, double bound){
+    float floatBound = (bound >= FLT_MAX) ? FLT_MAX : (bound < 0.0) ? -1.0f : (float)bound;
+    return (double)bounded_squared_l2_f32(p1, p2, size, floatBound);
+}
+
+double Eucledean::bounded_comparison_distance(const unsigned char* p1, const unsigned char* p2, int size, double bound){
+    uint32_t integerBound = (bound >= (double)UINT32_MAX) ? UINT32_MAX : (bound < 0.0) ? 0 : (uint32_t)bound; // The sums are integers so flooring loses nothing
+    return (double)bounded_squared_l2_u8(p1, p2, size, integerBound);
+}
+
+double Eucledean::bounded_comparison_distance(const float* p1, const unsigned char* p2, int size, double bound){
+    float floatBound = (bound >= FLT_MAX) ? FLT_MAX : (bound < 0.0) ? -1.0f : (float)bound;
+    return (double)bounded_squared_l2_f32_u8(p1, p2, size, floatBound);
+}
+
+double Eucledean::to_distance(double comparisonDistance){
+    return std::sqrt(comparisonDistance);
+}
+
+double Eucledean::to_comparison_distance(double distance){
+    if(distance < 0.0) return -1.0; // Nothing is closer than a negative radius
+    return distance * distance;
 }
@@ -4,14 +4,48 @@
 #include <vector>
 #include <cmath> // In case we need it for feature metrics
 
+// Every search ranks its candidates with comparison_distance, which only has to be monotone in the real distance
+// (the squared distance for Eucledean) and converts the few results it reports with to_distance
 class Metric{
     public:
     virtual double calculate_distance(const std::vector<double>& p1, const std::vector<double>& p2) = 0;
+    virtual double calculate_distance(const float* p1, const float* p2, int size) = 0; // For the rows of a DatasetStore
+    virtual double calculate_distance(const unsigned char* p1, const unsigned char* p2, int size) = 0; // For the rows of a uint8 DatasetStore
+    virtual double calculate_distance(const float* p1, const unsigned char* p2, int size) = 0; // A query that is not made of bytes against a uint8 row
+
+    virtual double comparison_distance(const std::vector<double>& p1, const std::vector<double>& p2) = 0;
+    virtual double comparison_distance(const float* p1, const float* p2, int size) = 0;
+    virtual double comparison_distance(const unsigned char* p1, const unsigned char* p2, int size) = 0;
+    virtual double comparison_distance(const float* p1, const unsigned char* p2, int size) = 0;
+    // May stop early once the result is certainly over the bound, see distance_kernels.h
+    virtual double bounded_comparison_distance(const float* p1, const float* p2, int size, double bound) = 0;
+    virtual double bounded_comparison_distance(const unsigned char* p1, const unsigned char* p2, int size, double bound) = 0;
+    virtual double bounded_comparison_distance(const float* p1, const unsigned char* p2, int size, double bound) = 0;
+    virtual double to_distance(double comparisonDistance) = 0;
+    virtual double to_comparison_distance(double distance) = 0; // For the radius of the range searches
+
+    // True if comparison_distance(x, y) == ||x||^2 - 2<x, y> + ||y||^2, which lets the batch searches score
+    // many points at once with dot products (see DatasetStore::comparison_distances)
+    virtual bool supports_norm_expansion(){ return false; }
 };
 
 class Eucledean : public Metric{
     public:
     double calculate_distance(const std::vector<double>& p1, const std::vector<double>& p2) override;
+    double calculate_distance(const float* p1, const float* p2, int size) override;
+    double calculate_distance(const unsigned char* p1, const unsigned char* p2, int size) override;
+    double calculate_distance(const float* p1, const unsigned char* p2, int size) override;
+
+    double comparison_distance(const std::vector<double>& p1, const std::vector<double>& p2) override; // The squared distance
+    double comparison_distance(const float* p1, const float* p2, int size) override;
+    double comparison_distance(const unsigned char* p1, const unsigned char* p2, int size) override;
+    double comparison_distance(const float* p1, const unsigned char* p2, int size) override;
+    double bounded_comparison_distance(const float* p1, const float* p2, int size, double bound) override;
+    double bounded_comparison_distance(const unsigned char* p1, const unsigned char* p2, int size, double bound) override;
+    double bounded_comparison_distance(const float* p1, const unsigned char* p2, int size, double bound) override;
+    double to_distance(double comparisonDistance) override;
+    double to_comparison_distance(double distance) override;
+    bool supports_norm_expansion() override{ return true; }
 };
 
 #endif
\ No newline at end of file
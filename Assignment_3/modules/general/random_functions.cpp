@@ -1,57 +1,129 @@
-#include "random_functions.h" // includes <random> and <vector>
+#include "random_functions.h"
 
-std::random_device Random::rd;
-std::mt19937 Random::gen(Random::rd());
+#include <cmath>
 
-int Random::generate_int_uniform(const int min, const int max){
+std::atomic<uint64_t> Random::NextStream(0);
+uint64_t Random::Seed = RANDOM_DEFAULT_SEED;
 
-    // Might need to change this initialization if it ends up being an important hinderance
-    // std::random_device rd; // Initiate a contingency factor
-    // std::mt19937 gen(rd()); // And seed them into the Mersenne Twister pseudorandom number generator 
+uint64_t Random::mix(uint64_t value){
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
 
-    std::uniform_int_distribution<> distribution(min, max);
+static uint64_t splitmix64(uint64_t& state){
+    return Random::mix(state += 0x9E3779B97F4A7C15ULL);
+}
 
-    return distribution(gen);
+static inline uint64_t rotate_left(uint64_t x, int k){
+    return (x << k) | (x >> (64 - k));
 }
 
-double Random::generate_double_uniform(const double min, const double max){
+Random::Random() : Random(new_stream(), 0){}
 
-    // std::random_device rd; // Initiate a contingency factor
-    // std::mt19937 gen(rd()); // And seed them into the Mersenne Twister pseudorandom number generator 
+Random::Random(uint64_t stream, uint64_t substream){
+    // Mix the seed, the stream and the substream so that neighboring numbers give unrelated states
+    uint64_t mixer = this->Seed;
+    uint64_t key = splitmix64(mixer) ^ stream;
+    key = splitmix64(key) ^ substream;
+    for(int i = 0; i < 4; i++) this->State[i] = splitmix64(key);
 
-    std::uniform_real_distribution<> distribution(min, max);
+    this->Stream = stream;
+    this->HasSpareNormal = false;
+    this->SpareNormal = 0.0;
+}
 
-    return distribution(gen);
+void Random::set_seed(uint64_t seed){
+    Seed = seed;
+    NextStream = 0;
 }
 
-double Random::generate_double_normal(const double mean, const double standardDeviation){
-    
-    // std::random_device rd; 
-    // std::mt19937 gen(rd()); 
+uint64_t Random::new_stream(){
+    return NextStream++;
+}
 
-    std::normal_distribution<double> distribution(mean, standardDeviation);
+uint64_t Random::get_stream(){
+    return this->Stream;
+}
 
-    return distribution(gen);
+uint64_t Random::generate_key(){
+    return next();
 }
 
-std::vector<double> Random::generate_vector_normal(int size, const double mean, const double standardDeviation){ // Size is the dimension of the vector
-    std::vector<double> vec;
+uint64_t Random::next(){ // xoshiro256**
+    uint64_t result = rotate_left(this->State[1] * 5, 7) * 9;
+    uint64_t t = this->State[1] << 17;
+
+    this->State[2] ^= this->State[0];
+    this->State[3] ^= this->State[1];
+    this->State[1] ^= this->State[2];
+    this->State[0] ^= this->State[3];
+    this->State[2] ^= t;
+    this->State[3] = rotate_left(this->State[3], 45);
+    return result;
+}
+
+double Random::next_double(){
+    return (double)(next() >> 11) * (1.0 / 9007199254740992.0); // The top 53 bits over 2^53
+}
+
+int Random::generate_int_uniform(const int min, const int max){
+    uint64_t range = (uint64_t)((int64_t)max - (int64_t)min) + 1;
+
+    // Multiply and keep the high half, throwing away the few values that would make some results more likely
+    uint64_t threshold = (0 - range) % range;
+    unsigned __int128 product;
+    do{
+        product = (unsigned __int128)next() * range;
+    }while((uint64_t)product < threshold);
+    return (int)((int64_t)min + (int64_t)(product >> 64));
+}
+
+double Random::generate_double_uniform(const double min, const double max){
+    return min + next_double() * (max - min);
+}
 
-    for (int i = 0; i < size; i++){ // Fill the vector with values up to its dimensions
-        double randomValue = generate_double_normal(mean, standardDeviation); // d-vector ~ N(0,1)^d from the notes
-        vec.push_back(randomValue); 
+double Random::generate_double_normal(const double mean, const double standardDeviation){
+    double u, v, s, factor;
+
+    if(this->HasSpareNormal){
+        this->HasSpareNormal = false;
+        return mean + standardDeviation * this->SpareNormal;
     }
 
+    // Marsaglia's polar method, two normals for every point that lands in the unit circle
+    do{
+        u = 2.0 * next_double() - 1.0;
+        v = 2.0 * next_double() - 1.0;
+        s = u * u + v * v;
+    }while(s >= 1.0 || s == 0.0);
+    factor = std::sqrt(-2.0 * std::log(s) / s);
+
+    this->SpareNormal = v * factor;
+    this->HasSpareNormal = true;
+    return mean + standardDeviation * u * factor;
+}
+
+std::vector<double> Random::generate_vector_normal(int size, const double mean, const double standardDeviation){ // Size is the dimension of the vector
+    std::vector<double> vec(size); // d-vector ~ N(0,1)^d from the notes
+    fill_normal(vec.data(), size, mean, standardDeviation);
     return vec;
 }
 
 std::vector<double> Random::generate_vector_uniform(int size, const double min, const double max){ // Size is the dimension of the vector
-    std::vector<double> vec;
+    std::vector<double> vec(size);
+    fill_uniform(vec.data(), size, min, max);
+    return vec;
+}
 
-    for (int i = 0; i < size; i++){ // Fill the vector with values up to its dimensions
-        double randomValue = generate_double_uniform(min, max); 
-        vec.push_back(randomValue); 
+void Random::fill_normal(double* values, int size, const double mean, const double standardDeviation){
+    for(int i = 0; i < size; i++){
+        values[i] = generate_double_normal(mean, standardDeviation);
     }
+}
 
-    return vec;
+void Random::fill_uniform(double* values, int size, const double min, const double max){
+    for(int i = 0; i < size; i++){
+        values[i] = min + next_double() * (max - min);
+    }
 }
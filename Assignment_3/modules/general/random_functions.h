@@ -1,20 +1,46 @@
 #ifndef RANDOM_FUNCTIONS_H //header guard for the vector header file which I know will be included elsewhere
 #define RANDOM_FUNCTIONS_H
 
-#include <random>
+#include <stdint.h>
+#include <atomic>
 #include <vector>
 
+#define RANDOM_DEFAULT_SEED 0x2023ULL // Same seed, same indexes, same results on every run
+
+// Every Random is its own xoshiro256** stream, seeded with splitmix64 from the global seed and the number of the stream.
+// The streams are numbered in the order they are created, so a program that creates them in the same order gets the same
+// numbers on every run, and two threads never share one. Where the order of creation can't be relied on (work split over
+// threads), Random(stream, substream) gives the same numbers for the same pair whatever thread asks
 class Random {
-    static std::random_device rd; // Static in order not to be initialized again and again
-    static std::mt19937 gen;
+    static std::atomic<uint64_t> NextStream;
+    static uint64_t Seed;
+
+    uint64_t State[4];
+    uint64_t Stream;
+    bool HasSpareNormal; // The normals come in pairs
+    double SpareNormal;
+
+    uint64_t next();
+    double next_double(); // [0, 1)
 
 public:
+    Random();
+    Random(uint64_t stream, uint64_t substream);
+    static void set_seed(uint64_t seed); // For the streams created after it, and the numbering starts over
+    static uint64_t new_stream();
+    uint64_t get_stream();
+    static uint64_t mix(uint64_t value); // splitmix64's finalizer, a fixed and well spread function of the value
+    uint64_t generate_key(); // 64 random bits, e.g. to key mix with
+
     int generate_int_uniform(const int min, const int max);
     double generate_double_uniform(const double min, const double max);
     double generate_double_normal(const double mean, const double standardDeviation);
     std::vector<double> generate_vector_normal(int size, const double mean, const double standardDeviation);
     std::vector<double> generate_vector_uniform(int size, const double min, const double max);
+    // The same in bulk, straight into the caller's memory
+    void fill_normal(double* values, int size, const double mean, const double standardDeviation);
+    void fill_uniform(double* values, int size, const double min, const double max);
 };
 
 
-#endif
\ No newline at end of file
+#endif
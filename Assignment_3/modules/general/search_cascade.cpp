@@ -0,0 +1,130 @@
+#include "search_cascade.h"
+
+#include <algorithm>
+
+SearchCascade::SearchCascade(Metric* metric){
+    this->CascadeMetric = metric;
+}
+
+bool SearchCascade::add_stage(const std::string& datasetFile, const std::string& querysetFile, int keep){
+    // The mappings only live for this function, the stores keep their own aligned and padded copy of the rows
+    MappedImages mappedDataset(datasetFile);
+    if(!mappedDataset.is_open() || mappedDataset.get_number_of_images() == 0){
+        printf("Error reading file: %s\n", datasetFile.c_str());
+        return false;
+    }
+    std::shared_ptr<DatasetStore> dataset = std::make_shared<DatasetStore>(mappedDataset, 0, STORE_UINT8);
+    dataset->order_dimensions_by_variance(); // Only the first stage scans, but the bounded distances help it a lot
+
+    std::shared_ptr<DatasetStore> queryset;
+    if(!querysetFile.empty()){
+        MappedImages mappedQueryset(querysetFile);
+        if(!mappedQueryset.is_open()){
+            printf("Error reading file: %s\n", querysetFile.c_str());
+            return false;
+        }
+        queryset = std::make_shared<DatasetStore>(mappedQueryset, dataset->size(), STORE_UINT8); // Same numbering as the drivers
+    }
+    add_stage(dataset, queryset, keep);
+    return true;
+}
+
+void SearchCascade::add_stage(std::shared_ptr<DatasetStore> dataset, std::shared_ptr<DatasetStore> queryset, int keep){
+    CascadeStage stage;
+    stage.Dataset = dataset;
+    stage.DatasetSpace = std::make_shared<SpaceCorrespondace>(dataset);
+    if(queryset != nullptr) stage.QuerysetSpace = std::make_shared<SpaceCorrespondace>(queryset);
+    stage.Keep = std::max(1, keep);
+    this->Stages.push_back(stage);
+}
+
+int SearchCascade::get_number_of_stages(){
+    return (int)this->Stages.size();
+}
+
+int SearchCascade::stage_keep(int stage, int numberOfNearest){
+    if(stage == (int)this->Stages.size() - 1) return numberOfNearest;
+    return std::max(this->Stages[stage].Keep, numberOfNearest);
+}
+
+StoreQuery SearchCascade::make_query(const CascadeStage& stage, int queryNumber, bool& found){
+    found = true;
+    int row = stage.DatasetSpace->get_initial_row(queryNumber);
+    if(row >= 0) return stage.Dataset->make_query_from_row(row);
+
+    std::shared_ptr<ImageVector> image = (stage.QuerysetSpace != nullptr) ? stage.QuerysetSpace->get_initial(queryNumber) : nullptr;
+    if(image == nullptr){
+        found = false;
+        return StoreQuery();
+    }
+    return stage.Dataset->make_query(image);
+}
+
+std::vector<std::pair<double, int>> SearchCascade::refine(int queryNumber, std::vector<int> numbers, int numberOfNearest){
+    std::vector<std::pair<double, int>> nearest;
+    bool found;
+
+    for(int s = 1; s < (int)this->Stages.size(); s++){
+        const CascadeStage& stage = this->Stages[s];
+        StoreQuery query = make_query(stage, queryNumber, found);
+        if(!found) return std::vector<std::pair<double, int>>();
+
+        // Only what the previous stage kept, scored all at once
+        nearest = stage.DatasetSpace->rerank_rows(query, numbers, stage_keep(s, numberOfNearest), this->CascadeMetric);
+        numbers.clear();
+        for(auto& pair : nearest){
+            pair.second = stage.Dataset->get_number(pair.second);
+            numbers.push_back(pair.second);
+        }
+    }
+    return nearest;
+}
+
+std::vector<std::pair<double, int>> SearchCascade::k_nearest_neighbors(int queryNumber, int numberOfNearest){
+    bool found;
+
+    if(this->Stages.empty()) return std::vector<std::pair<double, int>>();
+
+    const CascadeStage& first = this->Stages[0];
+    StoreQuery query = make_query(first, queryNumber, found);
+    if(!found) return std::vector<std::pair<double, int>>();
+
+    std::vector<std::pair<double, int>> nearest = exhaustive_nearest_neighbor_search_return_rows(first.Dataset, query, stage_keep(0, numberOfNearest), this->CascadeMetric);
+    std::vector<int> numbers;
+    for(auto& pair : nearest){
+        pair.second = first.Dataset->get_number(pair.second);
+        numbers.push_back(pair.second);
+    }
+    if(this->Stages.size() == 1) return nearest;
+    return refine(queryNumber, numbers, numberOfNearest);
+}
+
+std::vector<std::vector<std::pair<double, int>>> SearchCascade::k_nearest_neighbors_batch(const std::vector<int>& queryNumbers, int numberOfNearest){
+    int i;
+    bool found;
+    std::vector<std::vector<std::pair<double, int>>> nearest(queryNumbers.size());
+
+    if(this->Stages.empty()) return nearest;
+
+    // The queries the first stage knows, the others get no neighbors
+    const CascadeStage& first = this->Stages[0];
+    std::vector<StoreQuery> queries;
+    std::vector<int> positions;
+    for(i = 0; i < (int)queryNumbers.size(); i++){
+        StoreQuery query = make_query(first, queryNumbers[i], found);
+        if(!found) continue;
+        queries.push_back(query);
+        positions.push_back(i);
+    }
+
+    std::vector<std::vector<std::pair<double, int>>> firstNearest = exhaustive_nearest_neighbor_search_batch(first.Dataset, queries, stage_keep(0, numberOfNearest), this->CascadeMetric);
+    for(i = 0; i < (int)positions.size(); i++){
+        std::vector<int> numbers;
+        for(auto& pair : firstNearest[i]){
+            pair.second = first.Dataset->get_number(pair.second);
+            numbers.push_back(pair.second);
+        }
+        nearest[positions[i]] = (this->Stages.size() == 1) ? firstNearest[i] : refine(queryNumbers[positions[i]], numbers, numberOfNearest);
+    }
+    return nearest;
+}
@@ -0,0 +1,50 @@
+#ifndef SEARCH_CASCADE_H
+#define SEARCH_CASCADE_H
+
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "image_util.h"
+#include "dataset_store.h"
+
+// One encoding of the images (see reduce.py) that the cascade goes through
+class CascadeStage{
+    public:
+    std::shared_ptr<DatasetStore> Dataset;
+    std::shared_ptr<SpaceCorrespondace> DatasetSpace; // Image number -> row of Dataset
+    std::shared_ptr<SpaceCorrespondace> QuerysetSpace; // Image number -> query in this encoding, nullptr if only dataset images are asked about
+    int Keep; // Candidates handed to the next stage
+};
+
+// The k nearest neighbors through several encodings of the same images, coarsest first. The first stage scans its whole
+// dataset, every next one only scores the candidates the one before it kept, and the last one gives the answers.
+// So a 20-d scan keeping 1000, a 78-d pass keeping 100 and the 784-d images for the final 10 spend almost nothing on
+// the big vectors. The encodings keep the numbers of the images, that is how every stage finds the candidates and
+// the query in its own space
+class SearchCascade{
+    std::vector<CascadeStage> Stages;
+    Metric* CascadeMetric;
+
+    StoreQuery make_query(const CascadeStage& stage, int queryNumber, bool& found);
+    // The stages after the first one, numbers are the candidates the first stage kept
+    std::vector<std::pair<double, int>> refine(int queryNumber, std::vector<int> numbers, int numberOfNearest);
+    int stage_keep(int stage, int numberOfNearest); // The last stage keeps what was asked for, the others never less
+
+    public:
+    SearchCascade(Metric* metric);
+
+    // Loads the files through MappedImages into stores of their own, the mappings are closed once the rows are copied, so
+    // the stages search heap memory like the ones below. The queryset can be empty if only dataset images are asked about.
+    // False if they can't be read
+    bool add_stage(const std::string& datasetFile, const std::string& querysetFile, int keep);
+    void add_stage(std::shared_ptr<DatasetStore> dataset, std::shared_ptr<DatasetStore> queryset, int keep);
+    int get_number_of_stages();
+
+    // <distance in the last encoding, image number> pairs nearest first. The query is ignored if it is part of the dataset
+    std::vector<std::pair<double, int>> k_nearest_neighbors(int queryNumber, int numberOfNearest);
+    // The same for many queries, the first stage is the batch exhaustive search
+    std::vector<std::vector<std::pair<double, int>>> k_nearest_neighbors_batch(const std::vector<int>& queryNumbers, int numberOfNearest);
+};
+
+#endif
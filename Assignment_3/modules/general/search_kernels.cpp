@@ -0,0 +1,197 @@
+#include "search_kernels.h"
+#include "distance_kernels.h"
+
+#include <cfloat>
+#include <typeinfo>
+#include <immintrin.h>
+
+// The fixed size kernels go over whole vectors only. The rows and the queries of a store are zero padded past the
+// last dimension (64 bytes or 16 floats), so rounding the size up to a vector adds zeros on both sides and nothing else
+#define ROUND_UP(size, multiple) (((size) + (multiple) - 1) / (multiple) * (multiple))
+
+// ------------------------------------------------------------------------------ //
+// ------------------------------ Fixed size AVX2 ------------------------------- //
+// ------------------------------------------------------------------------------ //
+
+__attribute__((target("avx2")))
+static inline uint32_t horizontal_sum(__m256i v){
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2")))
+static inline float horizontal_sum(__m256 v){
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// Size is a multiple of 32 and known at compile time, so the whole loop unrolls and there is no tail. The bounded
+// version looks at the partial sum once every DISTANCE_BLOCK coordinates, like bounded_squared_l2_u8
+template<int Size, bool Bounded>
+__attribute__((target("avx2")))
+static uint32_t fixed_squared_l2_u8(const unsigned char* p1, const unsigned char* p2, uint32_t bound){
+    uint32_t total = 0;
+    __m256i sum = _mm256_setzero_si256();
+
+    #pragma GCC unroll 32
+    for(int i = 0; i < Size; i += 32){
+        __m256i difference0 = _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i))),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i))));
+        __m256i difference1 = _mm256_sub_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p1 + i + 16))),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p2 + i + 16))));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(difference0, difference0));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(difference1, difference1));
+        if(Bounded && (i + 32) % DISTANCE_BLOCK == 0 && i + 32 < Size){
+            total += horizontal_sum(sum);
+            if(total > bound) return total;
+            sum = _mm256_setzero_si256();
+        }
+    }
+    return total + horizontal_sum(sum);
+}
+
+// Size is a multiple of 8
+template<int Size, bool Bounded>
+__attribute__((target("avx2,fma")))
+static float fixed_squared_l2_f32_u8(const float* p1, const unsigned char* p2, float bound){
+    float total = 0.0f;
+    __m256 sum = _mm256_setzero_ps();
+
+    #pragma GCC unroll 8
+    for(int i = 0; i < Size; i += 8){
+        __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p2 + i))));
+        __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(p1 + i), x);
+        sum = _mm256_fmadd_ps(difference, difference, sum);
+        if(Bounded && (i + 8) % DISTANCE_BLOCK == 0 && i + 8 < Size){
+            total += horizontal_sum(sum);
+            if(total > bound) return total;
+            sum = _mm256_setzero_ps();
+        }
+    }
+    return total + horizontal_sum(sum);
+}
+
+// Size is a multiple of 8
+template<int Size, bool Bounded>
+__attribute__((target("avx2,fma")))
+static float fixed_squared_l2_f32(const float* p1, const float* p2, float bound){
+    float total = 0.0f;
+    __m256 sum = _mm256_setzero_ps();
+
+    #pragma GCC unroll 8
+    for(int i = 0; i < Size; i += 8){
+        __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(p1 + i), _mm256_loadu_ps(p2 + i));
+        sum = _mm256_fmadd_ps(difference, difference, sum);
+        if(Bounded && (i + 8) % DISTANCE_BLOCK == 0 && i + 8 < Size){
+            total += horizontal_sum(sum);
+            if(total > bound) return total;
+            sum = _mm256_setzero_ps();
+        }
+    }
+    return total + horizontal_sum(sum);
+}
+
+// ------------------------------------------------------------------------------ //
+// ------------------------------- Metric versions ------------------------------ //
+// ------------------------------------------------------------------------------ //
+
+// The fixed size distances of a metric type, they have to give what the virtual functions of the metric give.
+// A metric without a specialization here always goes through the Metric
+template<class MetricType> class FixedSizeKernels;
+
+template<> class FixedSizeKernels<Eucledean>{
+    // The bounds are clamped into the range of the kernel's type, same as Eucledean does
+    static uint32_t integer_bound(double bound){ return (bound >= (double)UINT32_MAX) ? UINT32_MAX : (bound < 0.0) ? 0 : (uint32_t)bound; }
+    static float float_bound(double bound){ return (bound >= FLT_MAX) ? FLT_MAX : (bound < 0.0) ? -1.0f : (float)bound; }
+
+    public:
+    template<int Size> static double comparison_u8(Metric*, const unsigned char* p1, const unsigned char* p2, int, double){
+        return (double)fixed_squared_l2_u8<ROUND_UP(Size, 32), false>(p1, p2, 0);
+    }
+    template<int Size> static double bounded_u8(Metric*, const unsigned char* p1, const unsigned char* p2, int, double bound){
+        return (double)fixed_squared_l2_u8<ROUND_UP(Size, 32), true>(p1, p2, integer_bound(bound));
+    }
+    template<int Size> static double comparison_f32_u8(Metric*, const float* p1, const unsigned char* p2, int, double){
+        return (double)fixed_squared_l2_f32_u8<ROUND_UP(Size, 8), false>(p1, p2, 0.0f);
+    }
+    template<int Size> static double bounded_f32_u8(Metric*, const float* p1, const unsigned char* p2, int, double bound){
+        return (double)fixed_squared_l2_f32_u8<ROUND_UP(Size, 8), true>(p1, p2, float_bound(bound));
+    }
+    template<int Size> static double comparison_f32(Metric*, const float* p1, const float* p2, int, double){
+        return (double)fixed_squared_l2_f32<ROUND_UP(Size, 8), false>(p1, p2, 0.0f);
+    }
+    template<int Size> static double bounded_f32(Metric*, const float* p1, const float* p2, int, double bound){
+        return (double)fixed_squared_l2_f32<ROUND_UP(Size, 8), true>(p1, p2, float_bound(bound));
+    }
+};
+
+template<class MetricType, int Size>
+static void use_fixed_size(SearchKernels& kernels){
+    kernels.ComparisonU8 = FixedSizeKernels<MetricType>::template comparison_u8<Size>;
+    kernels.BoundedU8 = FixedSizeKernels<MetricType>::template bounded_u8<Size>;
+    kernels.ComparisonF32U8 = FixedSizeKernels<MetricType>::template comparison_f32_u8<Size>;
+    kernels.BoundedF32U8 = FixedSizeKernels<MetricType>::template bounded_f32_u8<Size>;
+    kernels.ComparisonF32 = FixedSizeKernels<MetricType>::template comparison_f32<Size>;
+    kernels.BoundedF32 = FixedSizeKernels<MetricType>::template bounded_f32<Size>;
+    kernels.FixedSize = true;
+}
+
+// The MNIST images, and the latent dimensions that reduce.py is usually run with
+template<class MetricType>
+static void use_fixed_size(SearchKernels& kernels, int dimensions){
+    switch(dimensions){
+        case 784: use_fixed_size<MetricType, 784>(kernels); break;
+        case 78: use_fixed_size<MetricType, 78>(kernels); break;
+        case 20: use_fixed_size<MetricType, 20>(kernels); break;
+        default: break;
+    }
+}
+
+// ------------------------------------------------------------------------------ //
+// ----------------------------------- Generic ---------------------------------- //
+// ------------------------------------------------------------------------------ //
+
+static double metric_comparison_u8(Metric* metric, const unsigned char* p1, const unsigned char* p2, int size, double){
+    return metric->comparison_distance(p1, p2, size);
+}
+static double metric_bounded_u8(Metric* metric, const unsigned char* p1, const unsigned char* p2, int size, double bound){
+    return metric->bounded_comparison_distance(p1, p2, size, bound);
+}
+static double metric_comparison_f32_u8(Metric* metric, const float* p1, const unsigned char* p2, int size, double){
+    return metric->comparison_distance(p1, p2, size);
+}
+static double metric_bounded_f32_u8(Metric* metric, const float* p1, const unsigned char* p2, int size, double bound){
+    return metric->bounded_comparison_distance(p1, p2, size, bound);
+}
+static double metric_comparison_f32(Metric* metric, const float* p1, const float* p2, int size, double){
+    return metric->comparison_distance(p1, p2, size);
+}
+static double metric_bounded_f32(Metric* metric, const float* p1, const float* p2, int size, double bound){
+    return metric->bounded_comparison_distance(p1, p2, size, bound);
+}
+
+SearchKernels::SearchKernels() : SearchKernels(nullptr, 0){}
+
+SearchKernels::SearchKernels(Metric* metric, int dimensions){
+    this->KernelMetric = metric;
+    this->Dimensions = dimensions;
+    this->FixedSize = false;
+
+    this->ComparisonU8 = metric_comparison_u8;
+    this->BoundedU8 = metric_bounded_u8;
+    this->ComparisonF32U8 = metric_comparison_f32_u8;
+    this->BoundedF32U8 = metric_bounded_f32_u8;
+    this->ComparisonF32 = metric_comparison_f32;
+    this->BoundedF32 = metric_bounded_f32;
+
+    if(metric == nullptr || distance_kernels_level() < KERNELS_AVX2) return;
+    if(typeid(*metric) == typeid(Eucledean)){ // Exactly Eucledean, a subclass could have changed what the distances are
+        use_fixed_size<Eucledean>(*this, dimensions);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SEARCH_KERNELS_H
+#define SEARCH_KERNELS_H
+
+#include "metrics.h"
+
+// The row distances of one index, picked once when the index is constructed. When the metric has a fixed size
+// version (Eucledean, for 784 pixels or 20 and 78 latent dimensions) the distances are compiled for exactly that
+// row length, fully unrolled, and they never go through the virtual Metric calls. Anything else uses the Metric.
+// The fixed size versions read the zero padding of the rows, so they only take DatasetStore rows and StoreQuery data
+class SearchKernels{
+    public:
+    typedef double (*U8Kernel)(Metric*, const unsigned char*, const unsigned char*, int, double);
+    typedef double (*F32U8Kernel)(Metric*, const float*, const unsigned char*, int, double);
+    typedef double (*F32Kernel)(Metric*, const float*, const float*, int, double);
+
+    Metric* KernelMetric;
+    int Dimensions;
+    bool FixedSize; // False if it fell back to the Metric
+
+    U8Kernel ComparisonU8, BoundedU8;
+    F32U8Kernel ComparisonF32U8, BoundedF32U8;
+    F32Kernel ComparisonF32, BoundedF32;
+
+    SearchKernels();
+    SearchKernels(Metric* metric, int dimensions);
+
+    // Same as the Metric functions of the same name
+    double comparison_distance(const unsigned char* p1, const unsigned char* p2) const { return ComparisonU8(KernelMetric, p1, p2, Dimensions, 0.0); }
+    double comparison_distance(const float* p1, const unsigned char* p2) const { return ComparisonF32U8(KernelMetric, p1, p2, Dimensions, 0.0); }
+    double comparison_distance(const float* p1, const float* p2) const { return ComparisonF32(KernelMetric, p1, p2, Dimensions, 0.0); }
+    double bounded_comparison_distance(const unsigned char* p1, const unsigned char* p2, double bound) const { return BoundedU8(KernelMetric, p1, p2, Dimensions, bound); }
+    double bounded_comparison_distance(const float* p1, const unsigned char* p2, double bound) const { return BoundedF32U8(KernelMetric, p1, p2, Dimensions, bound); }
+    double bounded_comparison_distance(const float* p1, const float* p2, double bound) const { return BoundedF32(KernelMetric, p1, p2, Dimensions, bound); }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+static thread_local bool InsidePool = false; // True while the thread runs tasks of a job, worker or caller
+
+ThreadPool::ThreadPool(int numberOfThreads){
+    this->Stopping = false;
+    this->Task = nullptr;
+    this->NumberOfTasks = 0;
+    this->Generation = 0;
+    this->Busy = 0;
+    this->Joined = 0;
+    this->NextTask = 0;
+
+    for(int i = 1; i < numberOfThreads; i++){
+        this->Workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::unique_lock<std::mutex> lock(this->Lock);
+        this->Stopping = true;
+    }
+    this->WorkReady.notify_all();
+    for(auto& worker : this->Workers) worker.join();
+}
+
+int ThreadPool::size(){
+    return (int)this->Workers.size() + 1;
+}
+
+void ThreadPool::run_tasks(const std::function<void(int)>& task, int numberOfTasks){
+    int i;
+    bool wasInside = InsidePool;
+    InsidePool = true;
+    while((i = this->NextTask++) < numberOfTasks){
+        task(i);
+    }
+    InsidePool = wasInside;
+}
+
+void ThreadPool::work(){
+    unsigned long done = 0;
+    const std::function<void(int)>* task;
+    int numberOfTasks;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(this->Lock);
+            this->WorkReady.wait(lock, [&]{ return this->Stopping || this->Generation != done; });
+            if(this->Stopping) return;
+            done = this->Generation;
+            task = this->Task;
+            numberOfTasks = this->NumberOfTasks;
+            this->Busy++; // Before taking any task, so the caller waits for whatever we take
+            this->Joined++;
+        }
+        // If we woke up late every task is already taken and this does nothing. The job can't be replaced under us,
+        // parallel_for waits for every worker to join it before it returns
+        run_tasks(*task, numberOfTasks);
+        {
+            std::unique_lock<std::mutex> lock(this->Lock);
+            this->Busy--;
+            if(this->Busy == 0 && this->Joined == (int)this->Workers.size()) this->WorkDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int numberOfTasks, const std::function<void(int)>& task){
+    if(numberOfTasks <= 0) return;
+    // Nothing to hand out, or we are a task of a job already. The workers are all taken by that job (and Running is
+    // held by it), so a nested parallel_for would wait forever, it runs its tasks right here instead
+    if(this->Workers.empty() || numberOfTasks == 1 || InsidePool){
+        for(int i = 0; i < numberOfTasks; i++) task(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> running(this->Running);
+    {
+        std::unique_lock<std::mutex> lock(this->Lock);
+        this->Task = &task;
+        this->NumberOfTasks = numberOfTasks;
+        this->NextTask = 0;
+        this->Joined = 0;
+        this->Generation++;
+    }
+    this->WorkReady.notify_all();
+
+    run_tasks(task, numberOfTasks); // The caller works too
+
+    // Every task is taken by now, wait for the workers that took one. Also for the ones that haven't woken up yet, or they
+    // would read this job after it is gone and take tasks of the next one
+    std::unique_lock<std::mutex> lock(this->Lock);
+    this->WorkDone.wait(lock, [&]{ return this->Busy == 0 && this->Joined == (int)this->Workers.size(); });
+}
+
+ThreadPool& search_thread_pool(){
+    static ThreadPool pool(std::max(1, (int)std::thread::hardware_concurrency()));
+    return pool;
+}
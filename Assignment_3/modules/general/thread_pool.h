@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// A fixed set of worker threads for the searches that split the dataset between them. The threads are started
+// once and sleep between jobs, so a search does not pay for creating them every time
+class ThreadPool{
+    std::vector<std::thread> Workers;
+    std::mutex Lock;
+    std::mutex Running; // One job at a time
+    std::condition_variable WorkReady, WorkDone;
+    bool Stopping;
+
+    // The current job, the workers read them under Lock
+    const std::function<void(int)>* Task;
+    int NumberOfTasks;
+    unsigned long Generation; // Goes up with every job so a worker can tell a new one from the one it just did
+    int Busy; // Workers still inside the current job
+    int Joined; // Workers that have picked up the current job, a job is only over once all of them did and left it
+    std::atomic<int> NextTask;
+
+    void work();
+    void run_tasks(const std::function<void(int)>& task, int numberOfTasks);
+
+    public:
+    ThreadPool(int numberOfThreads); // Counting the thread that calls parallel_for, with 1 everything runs on it
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size();
+    // Calls task(0) up to task(numberOfTasks - 1) spread over the threads and returns once all of them are done. Called from
+    // inside a task (of any pool) it runs them one after the other on the calling thread, the outer job has the threads
+    void parallel_for(int numberOfTasks, const std::function<void(int)>& task);
+};
+
+ThreadPool& search_thread_pool(); // Shared by the searches, one thread per core
+
+#endif
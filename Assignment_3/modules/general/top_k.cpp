@@ -0,0 +1,32 @@
+#include "top_k.h"
+
+TopK::TopK(int capacity){
+    this->Capacity = 0;
+    this->Count = 0;
+    reset(capacity);
+}
+
+void TopK::reset(int capacity){
+    if(capacity < 0) capacity = 0;
+    if((int)this->Distances.size() < capacity){
+        this->Distances.resize(capacity);
+        this->Ids.resize(capacity);
+    }
+    this->Capacity = capacity;
+    this->Count = 0;
+}
+
+std::vector<std::pair<double, int>> TopK::to_distance_pairs(Metric* metric) const{
+    std::vector<std::pair<double, int>> pairs;
+    pairs.reserve(this->Count);
+    for(int i = 0; i < this->Count; i++){
+        pairs.push_back(std::make_pair(metric->to_distance(this->Distances[i]), this->Ids[i])); // Only the results get the real distance
+    }
+    return pairs;
+}
+
+void TopK::merge(const TopK& other){
+    for(int i = 0; i < other.size(); i++){
+        if(!push(other.distance(i), other.id(i))) break; // Sorted, nothing after this one can make it either
+    }
+}
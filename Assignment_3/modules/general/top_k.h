@@ -0,0 +1,61 @@
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <vector>
+#include <cfloat>
+
+#include "metrics.h"
+
+// The k best <distance, id> pairs seen so far, shared by all the searches. They are kept sorted in one flat array
+// that is allocated once, so a candidate that can't make it costs a single compare against bound() and the results
+// come out already in order. Ties go to the smaller id, same as the priority queues of pairs this replaced.
+// Meant for the small k of the searches, an insertion moves the worse pairs one place down
+class TopK{
+    int Capacity;
+    int Count;
+    std::vector<double> Distances; // Nearest first
+    std::vector<int> Ids;
+
+    public:
+    TopK(int capacity = 0);
+    void reset(int capacity); // Empties it, the storage is only reallocated if it has to grow
+
+    int size() const { return this->Count; }
+    bool empty() const { return this->Count == 0; }
+    double distance(int i) const { return this->Distances[i]; } // Of the i-th nearest
+    int id(int i) const { return this->Ids[i]; }
+
+    // What a candidate has to beat, DBL_MAX until it is full. Good as the bound of the bounded distances. With room for
+    // nothing it is -DBL_MAX, nothing can beat that
+    double bound() const {
+        if(this->Count < this->Capacity) return DBL_MAX;
+        return (this->Count == 0) ? -DBL_MAX : this->Distances[this->Count - 1];
+    }
+
+    bool push(double distance, int id); // False if it didn't make it
+    void merge(const TopK& other);
+
+    // <distance, id> pairs nearest first, the comparison distances turned into real ones by the metric
+    std::vector<std::pair<double, int>> to_distance_pairs(Metric* metric) const;
+};
+
+inline bool TopK::push(double distance, int id){
+    int i;
+
+    if(this->Count == this->Capacity){
+        if(this->Count == 0 || distance > this->Distances[this->Count - 1]) return false; // Almost every candidate stops here
+        if(distance == this->Distances[this->Count - 1] && id > this->Ids[this->Count - 1]) return false;
+        this->Count--; // The worst one makes room
+    }
+
+    for(i = this->Count; i > 0 && (this->Distances[i - 1] > distance || (this->Distances[i - 1] == distance && this->Ids[i - 1] > id)); i--){
+        this->Distances[i] = this->Distances[i - 1];
+        this->Ids[i] = this->Ids[i - 1];
+    }
+    this->Distances[i] = distance;
+    this->Ids[i] = id;
+    this->Count++;
+    return true;
+}
+
+#endif
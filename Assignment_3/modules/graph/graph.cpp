@@ -1,24 +1,26 @@
 #include "graph.h"
 
-const std::vector<std::shared_ptr<ImageVector>>& Graph::get_nodes(){
+std::shared_ptr<DatasetStore> Graph::get_nodes(){
     return this->Nodes;
 }
 
-const std::map<std::shared_ptr<ImageVector>, std::shared_ptr<Neighbors>>& Graph::get_nodes_neighbors(){
+const std::vector<Neighbors>& Graph::get_nodes_neighbors(){
     return this->NodesNeighbors;
 }
 
-Graph::Graph(std::vector<std::shared_ptr<ImageVector>> nodes, Metric* metric){
+Graph::Graph(std::shared_ptr<DatasetStore> nodes, Metric* metric){
     this->Nodes = nodes;
-    this->GraphMetric = metric;  
+    this->GraphMetric = metric;
+    this->GraphKernels = nodes->search_kernels(metric);  
+    this->NodesNeighbors.resize(nodes->size());
 }
 
-Graph::Graph(std::vector<std::shared_ptr<ImageVector>> nodes, std::vector<std::shared_ptr<Neighbors>> neighborList, Metric* metric){
+Graph::Graph(std::shared_ptr<DatasetStore> nodes, std::vector<Neighbors> neighborList, Metric* metric){
     this->Nodes = nodes;
     this->GraphMetric = metric;
-    for(int i = 0; i < (int)nodes.size(); i++){
-        this->NodesNeighbors[nodes[i]] = neighborList[i];
-    }   
+    this->GraphKernels = nodes->search_kernels(metric);
+    this->NodesNeighbors = neighborList;
+    this->NodesNeighbors.resize(nodes->size());
 }
 
 std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::k_nearest_neighbor_search(
@@ -26,28 +28,23 @@ std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::k_nearest_ne
     int randomRestarts, int greedySteps, int expansions, int K){ 
     // expansions means the number of neighbors the N(Y,E,G) function, from the notes, will return
 
-    int i, j, randomInt, nodesIndexNumber;
+    int i, j, node, minDistanceNode;
     
     double distance;
-
-    std::shared_ptr<ImageVector> node;
-    std::shared_ptr<ImageVector> minDistanceNode;
-    std::shared_ptr<Neighbors> neighbors;
+    StoreQuery queryRow = Nodes->make_query(query);
 
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
     
-    std::priority_queue<
-        std::pair<double, std::shared_ptr<ImageVector>>,  // A priority queue of pairs of distance and node
-        std::vector<std::pair<double, std::shared_ptr<ImageVector>>>, // Saving it in a vector of pairs<double, ImageVector>
-        std::less<std::pair<double, std::shared_ptr<ImageVector>>> // We need the top element in the PQ to be the one with the largest distance so we can quickly remove it
-    > S;
+    TopK S(K); // The K nearest <distance, row> pairs found so far
 
-    std::unordered_set<int> priorityQueueNodeNumbers; // This could prove problematic if we don't take care of the way we are loading multiple data files
+    std::unordered_set<int> priorityQueueNodeNumbers; // The rows that are already in the priority queue
+
+    // The restarts of every query come from a stream of their own, so the same query starts from the same nodes
+    // whatever was searched before it, and searches running side by side don't share a generator
+    Random restartGenerator(RandGenerator.get_stream(), (uint64_t)(uint32_t)query->get_number() + 1);
     for(i = 0; i < randomRestarts; i++){
-        randomInt = RandGenerator.generate_int_uniform(0, (int)Nodes.size() - 1);
-        
         // Starting with a random node chosen uniformly 
-        node = this->Nodes[randomInt];
+        node = restartGenerator.generate_int_uniform(0, Nodes->size() - 1);
 
         double previousMinDistance = DBL_MAX;
 
@@ -55,42 +52,35 @@ std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::k_nearest_ne
         for(j = 0; j < greedySteps; j++){
 
             // If the node has no neighbors, skip it
-            if(this->NodesNeighbors[node]->size() == 0) break;
+            if(this->NodesNeighbors[node].size() == 0) break;
 
             // Else continue with this node
-            neighbors = this->NodesNeighbors[node];
+            const Neighbors& neighbors = this->NodesNeighbors[node];
             
             // Don't exceed the number of neighbors we have available
-            if(expansions > (int)neighbors->size()){
-                expansions = (int)neighbors->size();
+            if(expansions > (int)neighbors.size()){
+                expansions = (int)neighbors.size();
             }
 
-            // Get the first E neighbors
-            auto neighborsKeepE = Neighbors(neighbors->begin(), neighbors->begin() + expansions);
-   
             double minDistance = DBL_MAX;
-            minDistanceNode = nullptr;
+            minDistanceNode = -1;
+
+            // For the first E neighbors
+            for(int e = 0; e < expansions; e++){
+                int tempNode = neighbors[e];
 
-            for(auto tempNode : neighborsKeepE){
                 // Calcuate the distance of the neighbor to the query
-                distance = GraphMetric->calculate_distance(tempNode->get_coordinates(), query->get_coordinates());
+                distance = Nodes->comparison_distance(queryRow, tempNode, GraphKernels);
                 if(distance < minDistance){
                     minDistance = distance;
                     minDistanceNode = tempNode;
                 }
-                
-                // Get the nodes's number in order to check if it is already in the priority queue
-                nodesIndexNumber = tempNode->get_number();
 
                 // If the neighbor is not already in the priority queue
-                if(priorityQueueNodeNumbers.find(nodesIndexNumber) == priorityQueueNodeNumbers.end()){         
-                    // Add the neighbor to the priority queue
-                    S.push(std::make_pair(distance, tempNode));
-                    // Make sure you keep the size correct
-                    if((int)S.size() > K){
-                        S.pop();
-                    }
-                    priorityQueueNodeNumbers.insert(nodesIndexNumber);
+                if(priorityQueueNodeNumbers.find(tempNode) == priorityQueueNodeNumbers.end()){         
+                    // Add the neighbor to the K nearest, it keeps its own size
+                    S.push(distance, tempNode);
+                    priorityQueueNodeNumbers.insert(tempNode);
                 }
             }
             
@@ -102,7 +92,7 @@ std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::k_nearest_ne
             previousMinDistance = minDistance;
             
             // Just to be on the safe side
-            if(minDistanceNode == nullptr){
+            if(minDistanceNode == -1){
                 break;
             }
             
@@ -110,44 +100,36 @@ std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::k_nearest_ne
         }
     }
     
-    // Reverse and Return the priority queue as a vector
-    while (!S.empty()){
-        nearestImages.push_back(S.top());
-        S.pop();
+    // Return the K nearest as a vector
+    for(int n = 0; n < S.size(); n++){ // Already nearest first
+        nearestImages.push_back(std::make_pair(GraphMetric->to_distance(S.distance(n)), Nodes->get_image(S.id(n))));
     }
-    
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> reversed(nearestImages.rbegin(), nearestImages.rend());
-    return reversed;
+    return nearestImages;
 }
 
-std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::generic_k_nearest_neighbor_search(std::shared_ptr<ImageVector> startNode, std::shared_ptr<ImageVector> query, int L, int K){
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::generic_k_nearest_neighbor_search(int startNode, std::shared_ptr<ImageVector> query, int L, int K){
     
     // Initializations
     bool foundUncheckedCandidate;
     
+    int node;
     double distance;
-
-    std::shared_ptr<ImageVector> node;
-    std::shared_ptr<Neighbors> neighbors;
+    StoreQuery queryRow = Nodes->make_query(query);
 
     // The set of candidates we have already checked
-    std::unordered_set<std::shared_ptr<ImageVector>> checkedCandidates; 
+    std::unordered_set<int> checkedCandidates; 
     
     // The set of candidates we are going to check
-    std::vector<std::shared_ptr<ImageVector>> candidateSetR; 
+    std::vector<int> candidateSetR; 
 
-    std::priority_queue<
-        std::pair<double, std::shared_ptr<ImageVector>>, 
-        std::vector<std::pair<double, std::shared_ptr<ImageVector>>>,
-        std::less<std::pair<double, std::shared_ptr<ImageVector>>>
-    > sortedCandidateSetR;
+    TopK sortedCandidateSetR(K);
 
     // "Add the starting node to the candidate set R"
     candidateSetR.push_back(startNode);
 
-    // In our case it is a priority queue, so we will also add the node with its distance to the query
-    distance = GraphMetric->calculate_distance(startNode->get_coordinates(), query->get_coordinates());
-    sortedCandidateSetR.push(std::make_pair(distance, startNode));
+    // In our case it is kept sorted, so we will also add the node with its distance to the query
+    distance = Nodes->comparison_distance(queryRow, startNode, GraphKernels);
+    sortedCandidateSetR.push(distance, startNode);
 
     // For a certain amount of candidates L
     int i = 0;
@@ -172,36 +154,30 @@ std::vector<std::pair<double, std::shared_ptr<ImageVector>>> Graph::generic_k_ne
             // If we didn't find an unchecked candidate, break
             break;
         }
-        neighbors = this->NodesNeighbors[node];
-        for(auto& neighbor : *neighbors){
+        for(auto& neighbor : this->NodesNeighbors[node]){
             // If the neighbor is not in the candidate set R
             if(std::find(candidateSetR.begin(), candidateSetR.end(), neighbor) == candidateSetR.end()){
                 // Add the neighbor to the candidate set R
                 candidateSetR.push_back(neighbor);
                 // And add the neighbor to the sorted candidate set R
-                distance = GraphMetric->calculate_distance(neighbor->get_coordinates(), query->get_coordinates());
-                sortedCandidateSetR.push(std::make_pair(distance, neighbor));
-                // But don't exceed the number of neighbors we want to return
-                if((int)sortedCandidateSetR.size() > K){
-                    sortedCandidateSetR.pop();
-                }
+                distance = Nodes->comparison_distance(queryRow, neighbor, GraphKernels);
+                // It never holds more than the K neighbors we want to return
+                sortedCandidateSetR.push(distance, neighbor);
             }
         }
         i++;
     }
 
-    // Reverse and Return the priority queue as a vector
+    // Return the sorted candidates as a vector
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
-    while (!sortedCandidateSetR.empty()){
-        nearestImages.push_back(sortedCandidateSetR.top());
-        sortedCandidateSetR.pop();
+    for(int n = 0; n < sortedCandidateSetR.size(); n++){ // Already nearest first
+        nearestImages.push_back(std::make_pair(GraphMetric->to_distance(sortedCandidateSetR.distance(n)), Nodes->get_image(sortedCandidateSetR.id(n))));
     }
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> reversed(nearestImages.rbegin(), nearestImages.rend());
-    return reversed;
+    return nearestImages;
 }
 
 void Graph::initialize_neighbours_approximate_method(std::shared_ptr<ApproximateMethods> method, int k){
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearest_approx;
+    std::vector<std::pair<double, int>> nearest_approx;
 
     // Load the data into the approximate method
     method->load_data(this->Nodes);
@@ -209,20 +185,19 @@ void Graph::initialize_neighbours_approximate_method(std::shared_ptr<Approximate
     printf("Creating the edge relations between the nodes/images... ");
     fflush(stdout);
     
-    for(auto& node : this->Nodes){
-        nearest_approx = method->approximate_k_nearest_neighbors_return_images(node, k);
+    for(int node = 0; node < Nodes->size(); node++){
+        nearest_approx = method->approximate_k_nearest_neighbors_of_row(node, k);
         
         // If the node has no neighbors, find the real ones with exhaustive search
         int countOfFailedApproximations = 0;
         if(nearest_approx.empty()){
             printf("Failed approximation: %d\n", countOfFailedApproximations++);
-            nearest_approx = exhaustive_nearest_neighbor_search_return_images(this->Nodes, node, k, this->GraphMetric);
+            nearest_approx = exhaustive_nearest_neighbor_search_return_rows(this->Nodes, Nodes->make_query_from_row(node), k, this->GraphMetric);
         }
 
-        // Make sure you create different pointers for each "Neighbors" structure
-        std::shared_ptr<Neighbors> neighbors = std::make_shared<Neighbors>(); 
+        Neighbors neighbors; 
         for(auto& neighbor : nearest_approx){
-            neighbors->push_back(neighbor.second);
+            neighbors.push_back(neighbor.second);
         }
         NodesNeighbors[node] = neighbors;
     }
@@ -9,37 +9,40 @@
 #include <cfloat>  // For MAX_DOUBLE
 
 #include "image_util.h"
+#include "dataset_store.h"
+#include "top_k.h"
 #include "random_functions.h"
 #include "metrics.h"
 #include "lsh.h"
 #include "hypercube.h"
 #include "approximate_methods.h"
 
-using Neighbors = std::vector<std::shared_ptr<ImageVector>>; 
+using Neighbors = std::vector<int>; // Rows of the graph's DatasetStore
 
 class Graph{
     
     protected:
-    std::vector<std::shared_ptr<ImageVector>> Nodes; 
-    std::map<std::shared_ptr<ImageVector>, std::shared_ptr<Neighbors>> NodesNeighbors; // The list of neighbors for each node
+    std::shared_ptr<DatasetStore> Nodes; // The nodes are the rows of the store
+    std::vector<Neighbors> NodesNeighbors; // The list of neighbors for each node, indexed by row
 
     // Note: Depending on how we initilaize the neighbor list it can we sorted or not
     // but initializing it with LSH/Hypercube will yield sorted results
     public:
     Random RandGenerator; // The random number generator we are using
     Metric* GraphMetric; // The metric we are using to calculate the distance between nodes
-    Graph(std::vector<std::shared_ptr<ImageVector>> nodes, Metric* metric);
-    Graph(std::vector<std::shared_ptr<ImageVector>> nodes, std::vector<std::shared_ptr<Neighbors>> neighborList, Metric* metric);
+    SearchKernels GraphKernels; // The same distances, fixed to the rows of Nodes
+    Graph(std::shared_ptr<DatasetStore> nodes, Metric* metric);
+    Graph(std::shared_ptr<DatasetStore> nodes, std::vector<Neighbors> neighborList, Metric* metric);
 
-    const std::vector<std::shared_ptr<ImageVector>>& get_nodes();
-    const std::map<std::shared_ptr<ImageVector>, std::shared_ptr<Neighbors>>& get_nodes_neighbors();
+    std::shared_ptr<DatasetStore> get_nodes();
+    const std::vector<Neighbors>& get_nodes_neighbors();
 
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> k_nearest_neighbor_search(
         std::shared_ptr<ImageVector> query, 
         int randomRestarts, int greedySteps, int expansions, int K);
 
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> generic_k_nearest_neighbor_search(
-        std::shared_ptr<ImageVector> startNode, 
+        int startNode, 
         std::shared_ptr<ImageVector> query, 
         int L, int K);
 
@@ -1,7 +1,7 @@
 #include "mrng.h"
 
 MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
-    std::vector<std::shared_ptr<ImageVector>> nodes, 
+    std::shared_ptr<DatasetStore> nodes, 
     std::shared_ptr<ApproximateMethods> method, int k,
     Metric* metric) : 
     Graph(nodes, metric){ // Constructor
@@ -15,40 +15,43 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
     double newValue;
     double fraction;
 
+    int dimensions = nodes->get_dimensions();
+
     // A zero vector to initialize the centroid with
-    std::vector<double> vectorZero(nodes[0]->get_coordinates().size(), 0.0);
+    std::vector<double> vectorZero(dimensions, 0.0);
 
     // Create a virtual point for the centroid
     this->Centroid = std::make_shared<ImageVector>(-1, vectorZero);
 
-    std::shared_ptr<Neighbors> Lp;
-
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> sortedRp;
+    std::vector<std::pair<double, int>> sortedRp;
         
+    std::vector<float> pRow(nodes->get_stride()); // The centroid is built from floats whatever the store keeps
+
     // ----- Construction Process ----- //
     // For every node p in nodes 
     double nodeCount = 0;
-    for(auto& p : nodes){
+    for(int p = 0; p < nodes->size(); p++){
+        nodes->copy_row(p, pRow.data());
         // printf("%d\n", __LINE__);
         // Incrementally building the centroid
         fraction = (nodeCount) / (nodeCount + 1);
         for (i = 0; i < (int)(this->Centroid)->get_coordinates().size(); i++){
             // printf("%d\n", __LINE__);
-            newValue = (fraction * (this->Centroid)->get_coordinates()[i]) + (p->get_coordinates()[i] / (nodeCount + 1));
+            newValue = (fraction * (this->Centroid)->get_coordinates()[i]) + (pRow[i] / (nodeCount + 1));
             (this->Centroid)->get_coordinates()[i] = newValue;
         }
         // printf("%d\n", __LINE__);
         nodeCount++;
 
-        sortedRp = method->approximate_k_nearest_neighbors_return_images(p, k);
+        sortedRp = method->approximate_k_nearest_neighbors_of_row(p, k);
         int countOfFailedApproximations = 0;
         if(sortedRp.empty()){
             printf("Failed approximation: %d\n", countOfFailedApproximations++);
-            sortedRp = exhaustive_nearest_neighbor_search_return_images(this->Nodes, p, k, metric);
+            sortedRp = exhaustive_nearest_neighbor_search_return_rows(this->Nodes, nodes->make_query_from_row(p), k, metric);
         }
 
-        Lp = std::make_shared<Neighbors>();
-        Lp->push_back(sortedRp[0].second);
+        Neighbors Lp;
+        Lp.push_back(sortedRp[0].second);
 
         // printf("%d\n", __LINE__);
 
@@ -58,19 +61,19 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
             // printf("%d\n", __LINE__);
             flag = true;
 
-            auto& v = vpair.second;
+            int v = vpair.second;
 
             // --and not in Lp
-            if(std::find(Lp->begin(), Lp->end(), v) != Lp->end()) continue; 
+            if(std::find(Lp.begin(), Lp.end(), v) != Lp.end()) continue; 
 
-            edgepv = this->GraphMetric->calculate_distance(p->get_coordinates(), v->get_coordinates());
+            edgepv = nodes->comparison_distance_between_rows(p, v, this->GraphKernels);
             
-            // and t in Lp (Lp is a shared_ptr or Neighbor type so we need to dereference it)
-            for(auto& t : *Lp){
-                // printf("Lp size: %d\n", (int)Lp->size());
+            // and t in Lp
+            for(auto& t : Lp){
+                // printf("Lp size: %d\n", (int)Lp.size());
                 // if edge(p,v) is NOT the longest edge in ANY triangle (p, v, t) i.e. it is shorter that at least one of the other edges
-                edgept = this->GraphMetric->calculate_distance(p->get_coordinates(), t->get_coordinates());
-                edgevt = this->GraphMetric->calculate_distance(v->get_coordinates(), t->get_coordinates());
+                edgept = nodes->comparison_distance_between_rows(p, t, this->GraphKernels);
+                edgevt = nodes->comparison_distance_between_rows(v, t, this->GraphKernels);
 
                 // if we find a triagle where edge(p,v) is the longest edge, then we break and return the false flag
                 if(
@@ -86,7 +89,7 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
             }
             // printf("%d\n", __LINE__);
             if(flag){
-                Lp->push_back(v);
+                Lp.push_back(v);
             }
         }
         // printf("%d\n", __LINE__);
@@ -94,10 +97,11 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
     }
     // printf("%d\n", __LINE__);
     // Find the closest real node to the virtual centroid of the dataset and assigns it to the NavigatingNode
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> vectorContainingNavigatingNode;
-    vectorContainingNavigatingNode = exhaustive_nearest_neighbor_search_return_images(this->Nodes, this->Centroid, 1, this->GraphMetric);
+    StoreQuery centroidQuery = nodes->make_query(this->Centroid);
+    std::vector<std::pair<double, int>> vectorContainingNavigatingNode;
+    vectorContainingNavigatingNode = exhaustive_nearest_neighbor_search_return_rows(this->Nodes, centroidQuery, 1, this->GraphMetric);
     if (vectorContainingNavigatingNode.empty()){
-        this->NavigatingNode = this->Nodes[this->RandGenerator.generate_int_uniform(0, (int)this->Nodes.size() - 1)];
+        this->NavigatingNode = this->RandGenerator.generate_int_uniform(0, nodes->size() - 1);
     }
     else{
         this->NavigatingNode = vectorContainingNavigatingNode[0].second;
@@ -108,7 +112,7 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
 }
 
 MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
-    std::vector<std::shared_ptr<ImageVector>> nodes, 
+    std::shared_ptr<DatasetStore> nodes, 
     Metric* metric) : 
     Graph(nodes, metric){ // Constructor
 
@@ -119,30 +123,33 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
     double newValue;
     double fraction;
 
+    int dimensions = nodes->get_dimensions();
+
     // A zero vector to initialize the centroid with
-    std::vector<double> vectorZero(nodes[0]->get_coordinates().size(), 0.0);
+    std::vector<double> vectorZero(dimensions, 0.0);
 
     // Create a virtual point for the centroid
     this->Centroid = std::make_shared<ImageVector>(-1, vectorZero);
 
-    std::shared_ptr<Neighbors> Lp;
-
     std::priority_queue<
-            std::pair<double, std::shared_ptr<ImageVector>>,  // A priority queue of pairs of distance and node
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>>, // Saving it in a vector of pairs<double, ImageVector>
-            std::greater<std::pair<double, std::shared_ptr<ImageVector>>> // We need the priority queue to be sorted in ascending order of the distance
+            std::pair<double, int>,  // A priority queue of pairs of distance and node
+            std::vector<std::pair<double, int>>, // Saving it in a vector of pairs<double, row>
+            std::greater<std::pair<double, int>> // We need the priority queue to be sorted in ascending order of the distance
     > sortedRp;
         
+    std::vector<float> pRow(nodes->get_stride()); // The centroid is built from floats whatever the store keeps
+
     // ----- Construction Process ----- //
     // For every node p in nodes 
     double nodeCount = 0;
-    for(auto& p : nodes){
+    for(int p = 0; p < nodes->size(); p++){
+        nodes->copy_row(p, pRow.data());
         // printf("%d\n", __LINE__);
         // Incrementally building the centroid
         fraction = (nodeCount) / (nodeCount + 1);
         for (i = 0; i < (int)(this->Centroid)->get_coordinates().size(); i++){
             // printf("%d\n", __LINE__);
-            newValue = (fraction * (this->Centroid)->get_coordinates()[i]) + (p->get_coordinates()[i] / (nodeCount + 1));
+            newValue = (fraction * (this->Centroid)->get_coordinates()[i]) + (pRow[i] / (nodeCount + 1));
             (this->Centroid)->get_coordinates()[i] = newValue;
         }
         // printf("%d\n", __LINE__);
@@ -153,14 +160,14 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
         //     sortedRp = exhaustive_nearest_neighbor_search_return_images(this->Nodes, p, k, metric);
         // }
 
-        for(auto& node : nodes){
-            distance = this->GraphMetric->calculate_distance(p->get_coordinates(), node->get_coordinates());
+        for(int node = 0; node < nodes->size(); node++){
+            distance = nodes->comparison_distance_between_rows(p, node, this->GraphKernels);
             if(distance != 0.0) sortedRp.push(std::make_pair(distance, node));
         }
 
 
-        Lp = std::make_shared<Neighbors>();
-        Lp->push_back(sortedRp.top().second);
+        Neighbors Lp;
+        Lp.push_back(sortedRp.top().second);
 
         // printf("%d\n", __LINE__);
 
@@ -170,20 +177,20 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
             // printf("%d\n", __LINE__);
             flag = true;
 
-            auto& v = sortedRp.top().second;
+            int v = sortedRp.top().second;
             sortedRp.pop();
 
             // --and not in Lp
-            if(std::find(Lp->begin(), Lp->end(), v) != Lp->end()) continue; 
+            if(std::find(Lp.begin(), Lp.end(), v) != Lp.end()) continue; 
 
-            edgepv = this->GraphMetric->calculate_distance(p->get_coordinates(), v->get_coordinates());
+            edgepv = nodes->comparison_distance_between_rows(p, v, this->GraphKernels);
             
-            // and t in Lp (Lp is a shared_ptr or Neighbor type so we need to dereference it)
-            for(auto& t : *Lp){
-                // printf("Lp size: %d\n", (int)Lp->size());
+            // and t in Lp
+            for(auto& t : Lp){
+                // printf("Lp size: %d\n", (int)Lp.size());
                 // if edge(p,v) is NOT the longest edge in ANY triangle (p, v, t) i.e. it is shorter that at least one of the other edges
-                edgept = this->GraphMetric->calculate_distance(p->get_coordinates(), t->get_coordinates());
-                edgevt = this->GraphMetric->calculate_distance(v->get_coordinates(), t->get_coordinates());
+                edgept = nodes->comparison_distance_between_rows(p, t, this->GraphKernels);
+                edgevt = nodes->comparison_distance_between_rows(v, t, this->GraphKernels);
 
                 // if we find a triagle where edge(p,v) is the longest edge, then we break and return the false flag
                 if(
@@ -199,7 +206,7 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
             }
             // printf("%d\n", __LINE__);
             if(flag){
-                Lp->push_back(v);
+                Lp.push_back(v);
             }
         }
         // printf("%d\n", __LINE__);
@@ -207,10 +214,11 @@ MonotonicRelativeNeighborGraph::MonotonicRelativeNeighborGraph(
     }
     // printf("%d\n", __LINE__);
     // Find the closest real node to the virtual centroid of the dataset and assigns it to the NavigatingNode
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> vectorContainingNavigatingNode;
-    vectorContainingNavigatingNode = exhaustive_nearest_neighbor_search_return_images(this->Nodes, this->Centroid, 1, this->GraphMetric);
+    StoreQuery centroidQuery = nodes->make_query(this->Centroid);
+    std::vector<std::pair<double, int>> vectorContainingNavigatingNode;
+    vectorContainingNavigatingNode = exhaustive_nearest_neighbor_search_return_rows(this->Nodes, centroidQuery, 1, this->GraphMetric);
     if (vectorContainingNavigatingNode.empty()){
-        this->NavigatingNode = this->Nodes[this->RandGenerator.generate_int_uniform(0, (int)this->Nodes.size() - 1)];
+        this->NavigatingNode = this->RandGenerator.generate_int_uniform(0, nodes->size() - 1);
     }
     else{
         this->NavigatingNode = vectorContainingNavigatingNode[0].second;
@@ -0,0 +1,177 @@
+#include "two_stage_search.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+TwoStageSearch::TwoStageSearch(std::shared_ptr<ApproximateMethods> reducedMethod, std::shared_ptr<DatasetStore> reducedStore, Metric* metric, double alpha){
+    reducedMethod->load_data(reducedStore); // Nothing happens if it already has it, LSH and HyperCube only load once
+    this->ReducedSearch = [reducedMethod](std::shared_ptr<ImageVector> reducedImage, int numberOfCandidates){
+        return reducedMethod->approximate_k_nearest_neighbors_return_images(reducedImage, numberOfCandidates);
+    };
+    this->ReducedSpace = std::make_shared<SpaceCorrespondace>(reducedStore);
+    this->TwoStageMetric = metric;
+    set_alpha(alpha);
+}
+
+TwoStageSearch::TwoStageSearch(std::shared_ptr<Graph> reducedGnns, int randomRestarts, int greedySteps, int expansions, Metric* metric, double alpha){
+    this->ReducedSearch = [reducedGnns, randomRestarts, greedySteps, expansions](std::shared_ptr<ImageVector> reducedImage, int numberOfCandidates){
+        return reducedGnns->k_nearest_neighbor_search(reducedImage, randomRestarts, greedySteps, expansions, numberOfCandidates);
+    };
+    this->ReducedSpace = std::make_shared<SpaceCorrespondace>(reducedGnns->get_nodes());
+    this->TwoStageMetric = metric;
+    set_alpha(alpha);
+}
+
+TwoStageSearch::TwoStageSearch(std::shared_ptr<MonotonicRelativeNeighborGraph> reducedMrng, int l, Metric* metric, double alpha){
+    this->ReducedSearch = [reducedMrng, l](std::shared_ptr<ImageVector> reducedImage, int numberOfCandidates){
+        return reducedMrng->k_nearest_neighbor_search(reducedImage, std::max(l, numberOfCandidates), numberOfCandidates); // It can't return more than it checks
+    };
+    this->ReducedSpace = std::make_shared<SpaceCorrespondace>(reducedMrng->get_nodes());
+    this->TwoStageMetric = metric;
+    set_alpha(alpha);
+}
+
+TwoStageSearch::TwoStageSearch(std::shared_ptr<DatasetStore> reducedStore, Metric* metric, double alpha){
+    this->ReducedSearch = [reducedStore, metric](std::shared_ptr<ImageVector> reducedImage, int numberOfCandidates){
+        return exhaustive_nearest_neighbor_search_return_images(reducedStore, reducedImage, numberOfCandidates, metric);
+    };
+    this->ReducedSpace = std::make_shared<SpaceCorrespondace>(reducedStore);
+    this->TwoStageMetric = metric;
+    set_alpha(alpha);
+}
+
+void TwoStageSearch::add_reduced_queries(const std::vector<std::shared_ptr<ImageVector>>& reducedQueries){
+    this->ReducedQueries = std::make_shared<SpaceCorrespondace>(reducedQueries);
+}
+
+void TwoStageSearch::add_reduced_queries(std::shared_ptr<DatasetStore> reducedQueries){
+    this->ReducedQueries = std::make_shared<SpaceCorrespondace>(reducedQueries);
+}
+
+void TwoStageSearch::set_alpha(double alpha){
+    this->Alpha = std::max(1.0, alpha); // Fewer candidates than neighbors makes no sense
+}
+
+double TwoStageSearch::get_alpha(){
+    return this->Alpha;
+}
+
+std::shared_ptr<ImageVector> TwoStageSearch::get_reduced(int number){
+    std::shared_ptr<ImageVector> reduced = this->ReducedSpace->get_initial(number);
+    if(reduced == nullptr && this->ReducedQueries != nullptr) reduced = this->ReducedQueries->get_initial(number);
+    return reduced;
+}
+
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> TwoStageSearch::candidates_of(int number, int numberOfCandidates){
+    std::shared_ptr<ImageVector> reduced = get_reduced(number);
+    if(reduced == nullptr) return std::vector<std::pair<double, std::shared_ptr<ImageVector>>>(); // Nothing to search the reduced space with
+    return this->ReducedSearch(reduced, numberOfCandidates);
+}
+
+int TwoStageSearch::number_of_candidates(int numberOfNearest){
+    return std::max(numberOfNearest, (int)std::ceil(this->Alpha * numberOfNearest));
+}
+
+std::vector<std::pair<double, int>> TwoStageSearch::k_nearest_rows(const StoreQuery& query, int numberOfNearest){
+    // One more candidate in case the reduced search finds the query itself, the re-ranking drops it
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> candidates = candidates_of(query.Number, number_of_candidates(numberOfNearest) + 1);
+    return this->OriginalSpace->rerank_rows(query, candidates, numberOfNearest, this->TwoStageMetric);
+}
+
+std::vector<std::pair<double, int>> TwoStageSearch::range_rows(const StoreQuery& query, double r){
+    std::vector<std::pair<double, int>> inRange = k_nearest_rows(query, TWO_STAGE_RANGE_CANDIDATES);
+
+    // Nearest first, so everything after the first one outside is outside as well
+    int inside = 0;
+    while(inside < (int)inRange.size() && inRange[inside].first <= r) inside++;
+    inRange.resize(inside);
+    return inRange;
+}
+
+double TwoStageSearch::tune_alpha(int numberOfNearest, double targetRecall, int sampleSize){
+    int i, found;
+    double alpha, recall;
+    Random rand;
+
+    if(this->OriginalStore == nullptr || this->OriginalStore->size() == 0){
+        printf("Error: TwoStageSearch needs the original space, call load_data first\n");
+        return this->Alpha;
+    }
+
+    std::vector<StoreQuery> queries;
+    for(i = 0; i < sampleSize; i++){
+        queries.push_back(this->OriginalStore->make_query_from_row(rand.generate_int_uniform(0, this->OriginalStore->size() - 1)));
+    }
+    std::vector<std::vector<std::pair<double, int>>> trueNearest = exhaustive_nearest_neighbor_search_batch(this->OriginalStore, queries, numberOfNearest, this->TwoStageMetric);
+
+    for(alpha = 1.0; ; alpha *= 2.0){
+        set_alpha(alpha);
+        found = 0;
+        int total = 0;
+        for(i = 0; i < sampleSize; i++){
+            std::unordered_set<int> trueRows;
+            for(auto& pair : trueNearest[i]) trueRows.insert(pair.second);
+            for(auto& pair : k_nearest_rows(queries[i], numberOfNearest)){
+                if(trueRows.count(pair.second)) found++;
+            }
+            total += (int)trueNearest[i].size();
+        }
+        recall = (total == 0) ? 1.0 : (double)found / total;
+        if(recall >= targetRecall || alpha * 2.0 > TWO_STAGE_MAX_ALPHA) break;
+    }
+    printf("Two stage search: alpha %g with recall %f\n", alpha, recall);
+    return alpha;
+}
+
+void TwoStageSearch::load_data(std::vector<std::shared_ptr<ImageVector>> images){
+    if(this->OriginalStore != nullptr){
+        return;
+    }
+    load_data(std::make_shared<DatasetStore>(images));
+}
+
+void TwoStageSearch::load_data(std::shared_ptr<DatasetStore> store){
+    if(this->OriginalStore != nullptr){
+        return;
+    }
+    this->OriginalStore = store;
+    this->OriginalSpace = std::make_shared<SpaceCorrespondace>(store);
+}
+
+std::vector<std::pair<double, int>> TwoStageSearch::approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest){
+    std::vector<std::pair<double, int>> nearest = k_nearest_rows(this->OriginalStore->make_query(image), numberOfNearest);
+
+    for(auto& pair : nearest){
+        pair.second = this->OriginalStore->get_number(pair.second);
+    }
+    return nearest;
+}
+
+std::vector<std::pair<double, int>> TwoStageSearch::approximate_range_search(std::shared_ptr<ImageVector> image, double r){
+    std::vector<std::pair<double, int>> inRange = range_rows(this->OriginalStore->make_query(image), r);
+
+    for(auto& pair : inRange){
+        pair.second = this->OriginalStore->get_number(pair.second);
+    }
+    return inRange;
+}
+
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> TwoStageSearch::approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r){
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> inRangeImages;
+    for(auto& pair : range_rows(this->OriginalStore->make_query(image), r)){
+        inRangeImages.push_back(std::make_pair(pair.first, this->OriginalStore->get_image(pair.second)));
+    }
+    return inRangeImages;
+}
+
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> TwoStageSearch::approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest){
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
+    for(auto& pair : k_nearest_rows(this->OriginalStore->make_query(image), numberOfNearest)){
+        nearestImages.push_back(std::make_pair(pair.first, this->OriginalStore->get_image(pair.second)));
+    }
+    return nearestImages;
+}
+
+std::vector<std::pair<double, int>> TwoStageSearch::approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest){
+    return k_nearest_rows(this->OriginalStore->make_query_from_row(row), numberOfNearest);
+}
@@ -0,0 +1,57 @@
+#ifndef TWO_STAGE_SEARCH_H
+#define TWO_STAGE_SEARCH_H
+
+#include <functional>
+
+#include "mrng.h"
+
+#define TWO_STAGE_DEFAULT_ALPHA 2.0 // Candidates fetched in the reduced space per neighbor asked for
+#define TWO_STAGE_MAX_ALPHA 64.0 // Where tune_alpha gives up
+#define TWO_STAGE_RANGE_CANDIDATES 1000 // The reduced distances say nothing about the original radius, so a range search checks this many
+
+// Searches the original space through an index of a reduced space (see reduce.py): it fetches alpha * k candidates there
+// and ranks them again by their exact distance in the original space with SpaceCorrespondace::rerank.
+// The reduced images keep the numbers of their originals, so a query has to be an image of the original dataset
+// or of a queryset whose reduced twin was given to add_reduced_queries. The original space is whatever load_data gets,
+// so it can be handed to Graph::initialize_neighbours_approximate_method or the MRNG constructor like LSH and HyperCube
+class TwoStageSearch : public ApproximateMethods{
+    // k candidates of a reduced image, <reduced distance, reduced image> pairs
+    std::function<std::vector<std::pair<double, std::shared_ptr<ImageVector>>>(std::shared_ptr<ImageVector>, int)> ReducedSearch;
+    std::shared_ptr<SpaceCorrespondace> ReducedSpace; // Image number -> reduced image, of the dataset
+    std::shared_ptr<SpaceCorrespondace> ReducedQueries; // And of the queries that are not part of it
+    std::shared_ptr<DatasetStore> OriginalStore;
+    std::shared_ptr<SpaceCorrespondace> OriginalSpace;
+    Metric* TwoStageMetric;
+    double Alpha;
+
+    std::shared_ptr<ImageVector> get_reduced(int number); // nullptr if there is no reduced twin
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> candidates_of(int number, int numberOfCandidates);
+    int number_of_candidates(int numberOfNearest);
+    std::vector<std::pair<double, int>> k_nearest_rows(const StoreQuery& query, int numberOfNearest); // <distance, original row> pairs
+    std::vector<std::pair<double, int>> range_rows(const StoreQuery& query, double r);
+
+    public:
+    // The reduced index has to be loaded with reducedStore, or it is loaded with it here
+    TwoStageSearch(std::shared_ptr<ApproximateMethods> reducedMethod, std::shared_ptr<DatasetStore> reducedStore, Metric* metric, double alpha = TWO_STAGE_DEFAULT_ALPHA); // LSH or HyperCube
+    TwoStageSearch(std::shared_ptr<Graph> reducedGnns, int randomRestarts, int greedySteps, int expansions, Metric* metric, double alpha = TWO_STAGE_DEFAULT_ALPHA);
+    TwoStageSearch(std::shared_ptr<MonotonicRelativeNeighborGraph> reducedMrng, int l, Metric* metric, double alpha = TWO_STAGE_DEFAULT_ALPHA);
+    TwoStageSearch(std::shared_ptr<DatasetStore> reducedStore, Metric* metric, double alpha = TWO_STAGE_DEFAULT_ALPHA); // Exhaustive
+
+    void add_reduced_queries(const std::vector<std::shared_ptr<ImageVector>>& reducedQueries);
+    void add_reduced_queries(std::shared_ptr<DatasetStore> reducedQueries); // The same straight from a store, its images are made as they are asked for
+    void set_alpha(double alpha);
+    double get_alpha();
+    // The smallest alpha, doubling from 1, whose average recall of the numberOfNearest on sampleSize random images of the
+    // original space reaches targetRecall (0 to 1). It is also set. Needs load_data first, the exact neighbors come from the batch exhaustive search
+    double tune_alpha(int numberOfNearest, double targetRecall, int sampleSize);
+
+    void load_data(std::vector<std::shared_ptr<ImageVector>> images) override; // The original space
+    void load_data(std::shared_ptr<DatasetStore> store) override;
+    std::vector<std::pair<double, int>> approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest) override;
+    std::vector<std::pair<double, int>> approximate_range_search(std::shared_ptr<ImageVector> image, double r) override;
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r) override;
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest) override;
+    std::vector<std::pair<double, int>> approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest) override;
+};
+
+#endif
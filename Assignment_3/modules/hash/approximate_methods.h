@@ -6,11 +6,14 @@
 class ApproximateMethods{
     public:
     virtual void load_data(std::vector<std::shared_ptr<ImageVector>> images) = 0;
+    virtual void load_data(std::shared_ptr<DatasetStore> store) = 0; // Lets several methods share the same store
     virtual std::vector<std::pair<double, int>> approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest) = 0;
     virtual std::vector<std::pair<double, int>> approximate_range_search(std::shared_ptr<ImageVector> image, double r) = 0;
     // Retroactive change
     virtual std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r) = 0;
     virtual std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest) = 0;
+    // The query is a row of the loaded store and so are the results, used while building the graphs
+    virtual std::vector<std::pair<double, int>> approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest) = 0;
 };
 
 #endif
\ No newline at end of file
@@ -1,9 +1,55 @@
 #include "hashtable.h"
 
-hFunction::hFunction(double window, int dimensions){
+ProjectionMatrix::ProjectionMatrix(int numberOfProjections, double window, int dimensions, ProjectionType type){
+    int i, j;
+    this->NumberOfProjections = numberOfProjections;
+    this->Dimensions = dimensions;
     this->W = window;
-    this->V = Rand.generate_vector_normal(dimensions, MEAN, STANDARD_DEVIATION); // The N(0,1) distribution
-    this->T = Rand.generate_double_uniform(0.0, this->W); 
+    this->T.resize(numberOfProjections);
+
+    if(type == PROJECTION_GAUSSIAN){
+        this->V.resize((size_t)numberOfProjections * dimensions);
+        std::vector<double> v(dimensions);
+        for(i = 0; i < numberOfProjections; i++){
+            Rand.fill_normal(v.data(), dimensions, MEAN, STANDARD_DEVIATION); // The N(0,1) distribution
+            for(j = 0; j < dimensions; j++) this->V[(size_t)i * dimensions + j] = (float)v[j];
+            this->T[i] = Rand.generate_double_uniform(0.0, this->W);
+        }
+    }
+    else{
+        double s = (type == PROJECTION_ACHLIOPTAS) ? 3.0 : std::sqrt((double)dimensions);
+        std::vector<int> negatives;
+        this->Scale = (float)std::sqrt(s);
+        if(type == PROJECTION_ACHLIOPTAS) this->V.resize((size_t)numberOfProjections * dimensions, 0.0f);
+        for(i = 0; i < numberOfProjections; i++){
+            this->Starts.push_back((int)this->Indexes.size());
+            negatives.clear();
+            for(j = 0; j < dimensions; j++){
+                double u = Rand.generate_double_uniform(0.0, 1.0);
+                if(u < 0.5 / s) this->Indexes.push_back(j);
+                else if(u < 1.0 / s) negatives.push_back(j);
+            }
+            this->Negatives.push_back((int)this->Indexes.size());
+            this->Indexes.insert(this->Indexes.end(), negatives.begin(), negatives.end());
+            this->T[i] = Rand.generate_double_uniform(0.0, this->W);
+        }
+        this->Starts.push_back((int)this->Indexes.size());
+
+        if(type == PROJECTION_ACHLIOPTAS){ // A third of the coordinates is too many for lists, the vector kernels are faster on the full matrix
+            for(i = 0; i < numberOfProjections; i++){
+                for(j = this->Starts[i]; j < this->Starts[i + 1]; j++){
+                    this->V[(size_t)i * dimensions + this->Indexes[j]] = (j < this->Negatives[i]) ? this->Scale : -this->Scale;
+                }
+            }
+            this->Indexes.clear();
+        }
+    }
+    if(!this->V.empty()){
+        this->Columns.resize(this->V.size());
+        for(i = 0; i < numberOfProjections; i++){
+            for(j = 0; j < dimensions; j++) this->Columns[(size_t)j * numberOfProjections + i] = this->V[(size_t)i * dimensions + j];
+        }
+    }
     // So we were explicitly instructed to use the uniform(0,W) distribution for t and N(0,1) for the values of v, 
     // but to also ensure that (p*v + t) is not negative?
     // Why are we allowing negative values in the first place then? 
@@ -11,97 +57,242 @@ hFunction::hFunction(double window, int dimensions){
     // so as to not have to worry about negative values?
 }
 
-int hFunction::evaluate_point(std::vector<double> p){ // h(p) = (p*v + t)/w
-    double product = std::inner_product(p.begin(), p.end(), (this->V).begin(), 0); 
-    
-    double result = (product + this->T)/ this->W;
-    
+int ProjectionMatrix::size(){
+    return this->NumberOfProjections;
+}
+
+int ProjectionMatrix::h_of(float product, int projection){ // h(p) = (p*v + t)/w
+    double result = ((double)product + this->T[projection]) / this->W;
     return (int)std::floor(result); // Casting the result into into so that we may operate it with other ints
 }
 
-gFunction::gFunction(int k, double window, int dimensions){
+double ProjectionMatrix::slot_position(float product, int projection){
+    double result = ((double)product + this->T[projection]) / this->W;
+    return result - std::floor(result);
+}
+
+bool ProjectionMatrix::project_sparse(const float* p, int first, int count, ProjectionScratch& scratch){
+    int i, j;
+
+    scratch.Products.resize(this->NumberOfProjections); // Only allocates the first time
+    float* products = scratch.Products.data();
+
+    if(this->V.empty()){ // PROJECTION_VERY_SPARSE
+        for(i = 0; i < count; i++){
+            const int* index = this->Indexes.data();
+            float positive = 0.0f, negative = 0.0f;
+            for(j = this->Starts[first + i]; j < this->Negatives[first + i]; j++) positive += p[index[j]];
+            for(; j < this->Starts[first + i + 1]; j++) negative += p[index[j]];
+            products[i] = this->Scale * (positive - negative);
+        }
+        return true;
+    }
+
+    scratch.Coordinates.resize(this->Dimensions);
+    int numberOfNonZeros = non_zero_coordinates_f32(p, this->Dimensions, scratch.Coordinates.data());
+    if(numberOfNonZeros * SPARSE_INPUT_RATIO > this->Dimensions) return false;
+
+    // Mostly zeros (80% of an MNIST image is), only the columns of the non zero coordinates are read
+    sparse_matrix_vector_f32(this->Columns.data() + first, count, this->NumberOfProjections, scratch.Coordinates.data(), numberOfNonZeros, p, products);
+    return true;
+}
+
+void ProjectionMatrix::project(const float* p, int first, int count, ProjectionScratch& scratch){
+    if(!project_sparse(p, first, count, scratch)){
+        matrix_vector_f32(this->V.data() + (size_t)first * this->Dimensions, count, this->Dimensions, p, scratch.Products.data()); // All of them in one go
+    }
+}
+
+void ProjectionMatrix::evaluate_point(const float* p, int first, int count, int* h, ProjectionScratch& scratch){
+    project(p, first, count, scratch);
+
+    for(int i = 0; i < count; i++){
+        h[i] = h_of(scratch.Products[i], first + i);
+    }
+}
+
+void ProjectionMatrix::evaluate_point(const float* p, int first, int count, int* h){
+    ProjectionScratch scratch;
+    evaluate_point(p, first, count, h, scratch);
+}
+
+void ProjectionMatrix::evaluate_rows(const std::shared_ptr<DatasetStore>& store, int firstRow, int numberOfRows, int* h){
+    int block, blockSize, r, i, numberOfDense;
+    int stride = store->get_stride();
+    std::vector<float> points((size_t)PROJECTION_ROW_BLOCK * stride); // The hash functions work on floats whatever the store keeps
+    std::vector<const float*> denseRows(PROJECTION_ROW_BLOCK), projectionRows;
+    std::vector<int> denseOffsets(PROJECTION_ROW_BLOCK); // Position of every dense row in the block
+    std::vector<float> products((size_t)this->NumberOfProjections * PROJECTION_ROW_BLOCK);
+    ProjectionScratch scratch; // For the sparse rows
+
+    // Only the dense matrices have rows to point at, the very sparse v_i always go through project_sparse and V is empty
+    if(!this->V.empty()){
+        projectionRows.resize(this->NumberOfProjections);
+        for(i = 0; i < this->NumberOfProjections; i++) projectionRows[i] = this->V.data() + (size_t)i * this->Dimensions;
+    }
+
+    for(block = 0; block < numberOfRows; block += PROJECTION_ROW_BLOCK){
+        blockSize = std::min(PROJECTION_ROW_BLOCK, numberOfRows - block);
+        numberOfDense = 0;
+        for(r = 0; r < blockSize; r++){
+            float* point = points.data() + (size_t)r * stride;
+            store->copy_row(firstRow + block + r, point);
+            if(project_sparse(point, 0, this->NumberOfProjections, scratch)){
+                for(i = 0; i < this->NumberOfProjections; i++) h[(size_t)(block + r) * this->NumberOfProjections + i] = h_of(scratch.Products[i], i);
+                continue;
+            }
+            denseRows[numberOfDense] = point;
+            denseOffsets[numberOfDense++] = r;
+        }
+        if(numberOfDense == 0) continue;
+
+        // The projections are the queries, so every dense row is read once per DOT_QUERY_TILE of them, products[i * numberOfDense + d]
+        dot_products_f32(projectionRows.data(), this->NumberOfProjections, denseRows.data(), numberOfDense, this->Dimensions, products.data());
+        for(r = 0; r < numberOfDense; r++){
+            for(i = 0; i < this->NumberOfProjections; i++){
+                h[(size_t)(block + denseOffsets[r]) * this->NumberOfProjections + i] = h_of(products[(size_t)i * numberOfDense + r], i);
+            }
+        }
+    }
+}
+
+void ProjectionMatrix::evaluate_point(const float* p, int* h){
+    evaluate_point(p, 0, this->NumberOfProjections, h);
+}
+
+void ProjectionMatrix::evaluate_point(const float* p, int* h, ProjectionScratch& scratch){
+    evaluate_point(p, 0, this->NumberOfProjections, h, scratch);
+}
+
+gFunction::gFunction(int k, double window, int dimensions, ProjectionType type) : gFunction(k, std::make_shared<ProjectionMatrix>(k, window, dimensions, type), 0){}
+
+gFunction::gFunction(int k, std::shared_ptr<ProjectionMatrix> h, int firstProjection){
     this->K = k;
-    this->W = window;
+    this->H = h;
+    this->FirstProjection = firstProjection;
     for(int i = 0; i < this->K; i++){
-        std::shared_ptr<hFunction> h = std::make_shared<hFunction>(window, dimensions); // Create a new h function, I used a pointer might not need it, I just said to myself after OOP that I'd always use pointers instead of storing objects directly, something that I haven't followed here generally
-        (this->H).push_back(h); // Save its pointer to the vector
         (this->R).push_back(Rand.generate_int_uniform(0, INT_MAX)); // Generate and save the r value
     }
 }
 
-int gFunction::evaluate_point(std::vector<double> p){
-    int res;
-    int sum = 0;
+int gFunction::evaluate_point(const float* p){
+    std::vector<int> h(this->K);
+    this->H->evaluate_point(p, this->FirstProjection, this->K, h.data());
+    return combine(h.data());
+}
+
+int gFunction::combine(const int* h){
+    // In 64 bits, r * h alone can be way over INT_MAX
+    int64_t sum = 0, hashValue;
     for(int i = 0; i < this->K; i++){
-        sum += ((this->R)[i] % M) * (((int)(this->H)[i]->evaluate_point(p)) % M); 
+        hashValue = h[i] % M;
+        if(hashValue < 0) hashValue += M; // Invoking the modular negation property in order to keep the result positive
+        sum = (sum + (int64_t)((this->R)[i] % M) * hashValue) % M;
     }
-    res = sum % M;
+    return (int)sum;
+}
 
-    if(res >= 0){
-        //printf("%d gFunction::%s result = %d\n", __LINE__, __FUNCTION__, res);
-        return res;
-    }
-    else{
-        //printf("%d gFunction::%s result:%d + M:%d = %d\n", __LINE__, __FUNCTION__, res, M, res+M);
-        return res+M; // Invoking the modular negation property in order to keep the result positive, this should be a very rare case after the changes in the p*v + t calculations 
-    }
+fFunction::fFunction(){
+    Random rand;
+    this->Key = rand.generate_key();
 }
 
-int fFunction::evaluate_point(int h_p){ // Taking the projection of a point and projecting it into 0 or 1
-    for(int i = 0; i < (int)(KnownValues.size()); i++){
-        if((KnownValues[i].first == h_p)){ // If we've encountered the value before
-            return KnownValues[i].second; // Fetch it from the known values
-        }
-    }
-    int result = Rand.generate_int_uniform(0, 1); // else generate a new one 
-    KnownValues.push_back(std::make_pair(h_p, result)); // and don't forget to save it 
-    return result;
+int fFunction::evaluate_point(int h_p) const{ // Taking the projection of a point and projecting it into 0 or 1
+    return (int)(Random::mix(this->Key ^ (uint64_t)(uint32_t)h_p) & 1); // Every bit of the mix is as good as any other
 }
 
 HashTable::HashTable(int num, std::shared_ptr<HashFunction> hashfunction){ // Constructor
         this->NumberOfBuckets = num;
         this->HF = hashfunction;
 }
-bool HashTable::same_id(std::shared_ptr<ImageVector> image1, std::shared_ptr<ImageVector> image2){ // Compares the id of two images, used in the querying trick
-    return NumberToId[image1->get_number()] == NumberToId[image2->get_number()];
+void HashTable::insert(int row, const float* p){ // Insert a row of the store to the hash table and save its id
+    insert_id(row, HF->evaluate_point(p));
 }
-void HashTable::insert(std::shared_ptr<ImageVector> image){ // Insert an image to the hash table and save its id
-    std::vector<double> p = image->get_coordinates();
-    int id = HF->evaluate_point(p);
-
-    NumberToId[image->get_number()] = id;
-
+void HashTable::insert_id(int row, int id){
+    if(this->Frozen){
+        thaw();
+    }
     int bucketId = id % NumberOfBuckets;
 
-    if(Table.find(bucketId) == Table.end()){
-        Table[bucketId] = std::vector<std::shared_ptr<ImageVector>>();
+    BucketEntries& bucket = Table[bucketId];
+    bucket.Rows.push_back((uint32_t)row);
+    bucket.Ids.push_back(id); // Kept next to the row for the querying trick
+}
+void HashTable::reserve(int numberOfRows){
+    Table.reserve(std::min(NumberOfBuckets, numberOfRows));
+}
+void HashTable::freeze(){
+    if(this->Frozen){
+        return;
     }
-
-    Table[bucketId].push_back(image);
+    // Count the rows of every bucket, and the running sum of the counts is where every bucket starts
+    this->Offsets.assign(NumberOfBuckets + 1, 0);
+    for(auto& bucket : Table){
+        this->Offsets[bucket.first + 1] = (uint32_t)bucket.second.Rows.size();
+    }
+    for(int b = 0; b < NumberOfBuckets; b++){
+        this->Offsets[b + 1] += this->Offsets[b];
+    }
+    this->Rows.resize(this->Offsets[NumberOfBuckets]);
+    this->Ids.resize(this->Offsets[NumberOfBuckets]);
+    for(auto& bucket : Table){ // Same order as they were inserted
+        std::copy(bucket.second.Rows.begin(), bucket.second.Rows.end(), this->Rows.begin() + this->Offsets[bucket.first]);
+        std::copy(bucket.second.Ids.begin(), bucket.second.Ids.end(), this->Ids.begin() + this->Offsets[bucket.first]);
+    }
+    std::unordered_map<int, BucketEntries>().swap(Table); // clear() would keep the bucket array
+    this->Frozen = true;
 }
-const std::vector<std::shared_ptr<ImageVector>>& HashTable::get_bucket_from_image_vector(std::shared_ptr<ImageVector> image){ // Returns the bucket a specific image resides in 
-    int bucketId = NumberToId[image->get_number()] % NumberOfBuckets;
-    return Table[bucketId];
+void HashTable::thaw(){
+    for(int b = 0; b < NumberOfBuckets; b++){
+        if(this->Offsets[b] != this->Offsets[b + 1]){
+            Table[b].Rows.assign(this->Rows.begin() + this->Offsets[b], this->Rows.begin() + this->Offsets[b + 1]);
+            Table[b].Ids.assign(this->Ids.begin() + this->Offsets[b], this->Ids.begin() + this->Offsets[b + 1]);
+        }
+    }
+    std::vector<uint32_t>().swap(this->Offsets);
+    std::vector<uint32_t>().swap(this->Rows);
+    std::vector<int>().swap(this->Ids);
+    this->Frozen = false;
 }
 
 
 // Retroactive change to the code, I need to be able to inquire about an image without it being in the hash table
 
-std::pair<int, int> HashTable::virtual_insert(std::shared_ptr<ImageVector> image){ // Get the bucket_id and the id of the image if you were to insert it
-    std::vector<double> p = image->get_coordinates();
-    int id = HF->evaluate_point(p);
+std::pair<int, int> HashTable::virtual_insert(const float* p){ // Get the bucket_id and the id of the image if you were to insert it
+    return virtual_insert_id(HF->evaluate_point(p));
+}
+
+std::pair<int, int> HashTable::virtual_insert_id(int id){
     int bucketId = id % NumberOfBuckets;
 
     return std::make_pair(bucketId, id);
 }
 
-int HashTable::get_image_id(std::shared_ptr<ImageVector> image){ // Get the id of an image
-    return NumberToId[image->get_number()];
+BucketRows HashTable::get_bucket_from_bucket_id(int bucketId){ 
+    BucketRows bucket;
+    if(this->Frozen){
+        bucket.First = this->Rows.data() + this->Offsets[bucketId];
+        bucket.Last = this->Rows.data() + this->Offsets[bucketId + 1];
+        bucket.Ids = this->Ids.data() + this->Offsets[bucketId];
+        return bucket;
+    }
+    auto it = Table.find(bucketId);
+    if(it == Table.end()){ // Don't create buckets while querying
+        bucket.First = bucket.Last = nullptr;
+        bucket.Ids = nullptr;
+        return bucket;
+    }
+    bucket.First = it->second.Rows.data();
+    bucket.Last = it->second.Rows.data() + it->second.Rows.size();
+    bucket.Ids = it->second.Ids.data();
+    return bucket;
 }
-
-const std::vector<std::shared_ptr<ImageVector>>& HashTable::get_bucket_from_bucket_id(int bucketId){ 
-    return Table[bucketId];
+int HashTable::largest_bucket(){
+    int largest = 0;
+    if(this->Frozen){
+        for(int b = 0; b < NumberOfBuckets; b++) largest = std::max(largest, (int)(this->Offsets[b + 1] - this->Offsets[b]));
+        return largest;
+    }
+    for(auto& bucket : Table) largest = std::max(largest, (int)bucket.second.Rows.size());
+    return largest;
 }
-int HashTable::get_bucket_id_from_image_vector(std::shared_ptr<ImageVector> image){
-    return NumberToId[image->get_number()] % NumberOfBuckets;
-}
\ No newline at end of file
@@ -6,10 +6,14 @@
 #include <queue>
 #include <algorithm>
 #include <climits>
+#include <numeric>
 
 #include "random_functions.h"
 #include "io_functions.h"
 #include "metrics.h"
+#include "dataset_store.h"
+#include "top_k.h"
+#include "distance_kernels.h"
 
 #define DIMENSIONS 784
 #define MODULO INT_MAX - 5
@@ -17,60 +21,137 @@
 #define WINDOW 1500 // Test orders of magnitude
 #define MEAN 0.0
 #define STANDARD_DEVIATION 1.0
+#define HASH_BUILD_ROWS_PER_TASK 4096 // Rows of the store that a thread hashes at a time while an index is built
+#define PROJECTION_ROW_BLOCK 64 // Rows turned into floats and multiplied with all the projections at once
 
 class HashFunction{
     public:
-    virtual int evaluate_point(std::vector<double> p) = 0;
+    virtual int evaluate_point(const float* p) = 0; // p is a row of a DatasetStore or a query made with make_query
 };
 
-class hFunction{
-    std::vector<double> V;
-    double T;
-    double  W = WINDOW;
+#define SPARSE_INPUT_RATIO 4 // Points with at most one in this many coordinates non zero are projected through the columns of those only
+
+// How the v vectors of the h functions are drawn
+enum ProjectionType{
+    PROJECTION_GAUSSIAN, // N(0,1) coordinates, the one from the notes
+    PROJECTION_ACHLIOPTAS, // sqrt(3) * {+1, 0, -1} with probabilities {1/6, 2/3, 1/6}, a third of the coordinates are used but
+                           // that is too many to be worth skipping the rest, it only saves the gaussian draws
+    PROJECTION_VERY_SPARSE // sqrt(s) * {+1, 0, -1} with probabilities {1/2s, 1 - 1/s, 1/2s} for s = sqrt(d), about 28 of the 784 pixels
+};
+// The sparse ones have the same variance as N(0,1) in every coordinate, so the same window works for all of them
+
+// The buffers of a projection, for the callers that keep them from one point to the next and so never allocate
+class ProjectionScratch{
+    public:
+    std::vector<float> Products; // p*v_i
+    std::vector<int> Coordinates; // The non zero coordinates of p
+};
+
+// Several h functions, h_i(p) = floor((p*v_i + t_i)/w), with the v_i as the rows of one contiguous matrix.
+// All of them are evaluated with a single matrix_vector_f32 call on the point, nothing gets copied. When most of the
+// point is zeros only the columns of its non zero coordinates are read instead, and the very sparse v_i are kept as
+// the lists of their non zero coordinates
+class ProjectionMatrix{
+    int NumberOfProjections;
+    int Dimensions;
+    double W = WINDOW;
+    std::vector<float> V; // NumberOfProjections x Dimensions, row-major. Empty for PROJECTION_VERY_SPARSE
+    std::vector<float> Columns; // The same transposed, Dimensions x NumberOfProjections, for the sparse points
+    std::vector<int> Indexes; // PROJECTION_VERY_SPARSE: the coordinates where v_i is +Scale and then the ones where it is -Scale, v_0 first
+    std::vector<int> Starts; // v_i's coordinates are Indexes[Starts[i]] to Indexes[Starts[i + 1] - 1]
+    std::vector<int> Negatives; // and the -Scale ones start at Indexes[Negatives[i]]
+    float Scale = 1.0f;
+    std::vector<double> T;
     Random Rand;
 
+    int h_of(float product, int projection); // floor((p*v + t)/w) once p*v is known
+    void project(const float* p, int first, int count, ProjectionScratch& scratch); // scratch.Products[i] = p*v_(first + i)
+    bool project_sparse(const float* p, int first, int count, ProjectionScratch& scratch); // The same if p or the v_i are sparse enough, false otherwise
+
     public:
-    hFunction(double window, int dimensions);
-    int evaluate_point(std::vector<double> p);
+    ProjectionMatrix(int numberOfProjections, double window, int dimensions, ProjectionType type = PROJECTION_GAUSSIAN);
+    int size();
+    void evaluate_point(const float* p, int* h); // h gets size() values
+    void evaluate_point(const float* p, int first, int count, int* h); // Only the rows first to first + count - 1
+    void evaluate_point(const float* p, int* h, ProjectionScratch& scratch);
+    void evaluate_point(const float* p, int first, int count, int* h, ProjectionScratch& scratch);
+    double slot_position(float product, int projection); // Where (p*v + t)/w falls in its slot, 0 at the bottom and 1 at the top
+    // Every h of the rows firstRow to firstRow + numberOfRows - 1 of a store, h[(row - firstRow) * size() + i]. The dense rows go
+    // through a blocked matrix multiply with all the projections (see dot_products_f32) instead of one product per row, the
+    // sparse ones through their non zero coordinates. Only reads the matrix, so threads can hash different rows at the same time
+    void evaluate_rows(const std::shared_ptr<DatasetStore>& store, int firstRow, int numberOfRows, int* h);
 };
 
 class gFunction : public HashFunction{
-    double W = WINDOW; // The window
     int K; // Number of hi functions that a g will be combining
     int M = MODULO; // The modulo
-    std::vector<std::shared_ptr<hFunction>> H;
+    std::shared_ptr<ProjectionMatrix> H; // Its K h functions are the rows FirstProjection to FirstProjection + K - 1
+    int FirstProjection;
     std::vector<int> R; // The r values that will be used in the g function
     Random Rand; // Random generator
 
     public:
-    gFunction(int k, double window, int dimensions);
-    int evaluate_point(std::vector<double> p) override;
+    gFunction(int k, double window, int dimensions, ProjectionType type = PROJECTION_GAUSSIAN); // With h functions of its own
+    gFunction(int k, std::shared_ptr<ProjectionMatrix> h, int firstProjection); // Sharing them with other g functions, see LSH
+    int evaluate_point(const float* p) override;
+    int combine(const int* h); // g out of the values of its K h functions, for when they were evaluated all together
 };
 
+// f(h) is a random bit for every h, but instead of remembering the bits it has handed out it hashes h with a random key.
+// So it is the same bit every time without any state to search or update, and queries can share it between threads
 class fFunction{
-    std::vector<std::pair<int, int>> KnownValues; // <h(p), f(h(p)) pairs
-    Random Rand;
+    uint64_t Key;
+
+    public:
+    fFunction();
+    int evaluate_point(int h_p) const; // Taking the projection of a point and projecting it into 0 or 1
+};
 
+// The rows of one bucket and their full ids (the g(p) they were inserted with), read straight out of the table
+class BucketRows{
     public:
-    int evaluate_point(int h_p); // Taking the projection of a point and projecting it into 0 or 1
+    const uint32_t* First;
+    const uint32_t* Last;
+    const int* Ids; // Ids[i] is the id of row First[i]
+
+    int size() const { return (int)(Last - First); }
+    int operator[](int i) const { return (int)First[i]; }
+    // The positions i with Ids[i] == id, all compared before any row is looked at. positions needs room for size() of them
+    int positions_with_id(int id, int* positions) const { return equal_positions_i32(Ids, size(), id, positions); }
+};
+
+// The rows of a bucket and their ids side by side, so that the ids can be compared with vector instructions
+class BucketEntries{
+    public:
+    std::vector<uint32_t> Rows;
+    std::vector<int> Ids;
 };
 
 class HashTable{
     int NumberOfBuckets;
     std::shared_ptr<HashFunction> HF;
-    std::unordered_map<int, std::vector<std::shared_ptr<ImageVector>>> Table;
-    std::unordered_map<int, int> NumberToId; // <number, id> pairs
+    std::unordered_map<int, BucketEntries> Table; // Bucket id -> rows of the DatasetStore, until the table is frozen
+
+    // After freeze() every bucket is a piece of two arrays, bucket b is Rows[Offsets[b]] to Rows[Offsets[b + 1] - 1]
+    // and Ids the same. Two reads to find a bucket and 8 bytes per row instead of a map node and two vectors for every bucket
+    bool Frozen = false;
+    std::vector<uint32_t> Offsets;
+    std::vector<uint32_t> Rows;
+    std::vector<int> Ids;
+
+    void thaw(); // Back to the map, for an insert after freeze()
 
     public:
     HashTable(int num, std::shared_ptr<HashFunction> hashfunction);
-    bool same_id(std::shared_ptr<ImageVector> image1, std::shared_ptr<ImageVector> image2);
-    void insert(std::shared_ptr<ImageVector> image);
-    const std::vector<std::shared_ptr<ImageVector>>& get_bucket_from_image_vector(std::shared_ptr<ImageVector> image);
-
-    std::pair<int, int> virtual_insert(std::shared_ptr<ImageVector> image);
-    int get_image_id(std::shared_ptr<ImageVector> image);
-    const std::vector<std::shared_ptr<ImageVector>>& get_bucket_from_bucket_id(int bucketId);
-    int get_bucket_id_from_image_vector(std::shared_ptr<ImageVector> image);
+    void insert(int row, const float* p);
+    void insert_id(int row, int id); // The id was already found with the hash function
+    void reserve(int numberOfRows); // Before inserting that many rows
+    void freeze(); // Once everything is inserted, see Offsets
+
+    std::pair<int, int> virtual_insert(const float* p);
+    std::pair<int, int> virtual_insert_id(int id);
+    BucketRows get_bucket_from_bucket_id(int bucketId);
+    int largest_bucket(); // The rows in the fullest bucket
 };
 
 #endif
\ No newline at end of file
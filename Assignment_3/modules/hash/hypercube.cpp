@@ -1,4 +1,5 @@
 #include "hypercube.h"
+#include "thread_pool.h"
 
 long double factorial(int n){
     if(n < 0) return 0;
@@ -77,30 +78,35 @@ std::vector<int> get_probes(int number, int maxHammingDistance, int dimensions){
     }
     return probes;
 }
-HypercubeHashFunction::HypercubeHashFunction(int k, double window, int dimensions){ // Constructor 
-    std::shared_ptr<hFunction> h;
+HypercubeHashFunction::HypercubeHashFunction(int k, double window, int dimensions, ProjectionType type){ // Constructor 
     std::shared_ptr<fFunction> f;
     this->K = k;
+    this->H = std::make_shared<ProjectionMatrix>(k, window, dimensions, type);
     for(int i = 0; i < this->K; i++){
-        h = std::make_shared<hFunction>(window, dimensions);
-        H.push_back(h);
-
         f = std::make_shared<fFunction>();
         F.push_back(f);
     }
 }
-int HypercubeHashFunction::evaluate_point(std::vector<double> p){
+int HypercubeHashFunction::evaluate_point(const float* p){
+    std::vector<int> h(this->K);
+    H->evaluate_point(p, h.data()); // All the projections at once
+    return combine(h.data());
+}
+int HypercubeHashFunction::combine(const int* h){
     int bDigit;
     int hashCode = 0;
     for(int i = 0; i < this->K; i++){
-        bDigit = F[i]->evaluate_point(H[i]->evaluate_point(p));
+        bDigit = F[i]->evaluate_point(h[i]);
         hashCode <<= 1; // shift so that we have some space for the next digit
         hashCode |= bDigit; // save the code of the particular projection
     }
     return hashCode;
 }
+std::shared_ptr<ProjectionMatrix> HypercubeHashFunction::get_projections(){
+    return this->H;
+}
 
-HyperCube::HyperCube(int dimensions, int probes, int numberOfElementsToCheck, double window,Metric* metric, int dataDimensions){
+HyperCube::HyperCube(int dimensions, int probes, int numberOfElementsToCheck, double window,Metric* metric, int dataDimensions, ProjectionType type){
     this->M = numberOfElementsToCheck;
     this->K = dimensions;
     this->Probes = probes;
@@ -109,10 +115,10 @@ HyperCube::HyperCube(int dimensions, int probes, int numberOfElementsToCheck, do
     this->W = window;
     this->DataDimensions = dataDimensions;
 
-    std::shared_ptr<HashFunction> hashFunction = std::make_shared<HypercubeHashFunction>(this->K, this->W, this->DataDimensions);
+    this->Hash = std::make_shared<HypercubeHashFunction>(this->K, this->W, this->DataDimensions, type);
     int numberOfBuckets = 1 << K; // Essentially 2^K
 
-    this->Table = std::make_shared<HashTable>(numberOfBuckets, hashFunction);
+    this->Table = std::make_shared<HashTable>(numberOfBuckets, this->Hash);
 
     // Calculate the maximum hamming distance to look at given that we want to visit at most this->Probes vertices
     // by finding the smallest maxHammingDistance that represents more vertices than this->Probes
@@ -124,135 +130,98 @@ HyperCube::HyperCube(int dimensions, int probes, int numberOfElementsToCheck, do
     }while(numOfProbes < this->Probes && numOfProbes < (1 << this->K) -1 ); // It's -1 cause we don't want to count the vertex itself
 }
 void HyperCube::load_data(std::vector<std::shared_ptr<ImageVector>> images){
+    if(this->DataLoaded){
+        return;
+    }
+    load_data(std::make_shared<DatasetStore>(images));
+}
+void HyperCube::load_data(std::shared_ptr<DatasetStore> store){
+    if(this->DataLoaded){ // Loading it twice would put every row in its vertex twice
+        return;
+    }
+    this->Store = store;
+    this->Kernels = store->search_kernels(this->Hmetric);
     printf("Loading data into the hypercube... ");
     fflush(stdout);
-    for (int i = 0; i < (int)(images.size()); i++){
-        (this->Table)->insert(images[i]);
+    int numberOfRows = Store->size();
+    int numberOfTasks = (numberOfRows + HASH_BUILD_ROWS_PER_TASK - 1) / HASH_BUILD_ROWS_PER_TASK;
+    std::shared_ptr<ProjectionMatrix> projections = this->Hash->get_projections();
+    std::vector<int> ids(numberOfRows);
+
+    // Every projection of the dataset as one blocked matrix multiply split over the threads, the f functions are
+    // read only so the vertices come out of the same tasks
+    search_thread_pool().parallel_for(numberOfTasks, [&](int task){
+        int firstRow = task * HASH_BUILD_ROWS_PER_TASK;
+        int count = std::min(HASH_BUILD_ROWS_PER_TASK, numberOfRows - firstRow);
+        std::vector<int> h((size_t)count * this->K);
+        projections->evaluate_rows(Store, firstRow, count, h.data());
+        for(int r = 0; r < count; r++){
+            ids[firstRow + r] = this->Hash->combine(h.data() + (size_t)r * this->K);
+        }
+    });
+
+    this->Table->reserve(numberOfRows);
+    for (int i = 0; i < numberOfRows; i++){
+        (this->Table)->insert_id(i, ids[i]);
     }
+    this->Table->freeze(); // Nothing else gets inserted, so every vertex can be one piece of an array
+    this->DataLoaded = true;
     printf("Done\n");
     fflush(stdout);
 }
-std::vector<std::pair<double, int>> HyperCube::approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest){
-    int i, j, prospectImageNumber;
-    double distance;
-    int visitedPointsCounter = 0;
-    int queryImageNumber = image->get_number();
-
-    // This will be saving all the bucket_ids/hypercube vertices that we will be visiting
-    std::vector<int> probes;
-    std::vector<std::shared_ptr<ImageVector>> bucket;
-
-    // I will be using a priority queue to keep the k nearest neighbors
-    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::less<std::pair<double, int>>> nearest;
-
-    // Let b ← Null; db ← ∞; initialize k best candidates and distances;
-    std::vector<std::pair<double, int>> nearestImages;
-    
-    // Get the bucket id
-    int bucketId = Table->get_bucket_id_from_image_vector(image);
-
-    probes = get_probes(bucketId, this->MaxHammingDistance, this->K);
-
-    // For each probe / i.e. for each neighboring vertex of the hypercube within #probe steps
-    // i = 0;
-    // while(i < (int)(probes.size()) && visitedPointsCounter < (this->M)){
-    for(i = 0; i < this->Probes; i++){
-        // Get the bucket
-        bucket = (this->Table)->get_bucket_from_bucket_id(probes[i]);  
-
-        // Search the bucket for the nearest neighbors
-        j = 0;
-        while(j < (int)(bucket.size()) && visitedPointsCounter < (this->M)){
-            visitedPointsCounter++;
 
-            prospectImageNumber = bucket[j]->get_number();
-
-            // Ignore comparing with itself
-            if(prospectImageNumber != queryImageNumber){ 
-                // dist(p,q)
-                distance = Hmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
-
-                nearest.push(std::make_pair(distance, prospectImageNumber));
-
-                // Keep the number of nearest neighbors the correct size
-                if((int)nearest.size() > numberOfNearest){
-                    nearest.pop();
-                }
-            }
-            j++;
-        }
-        // i++;
-    }
-    // Fill up the a structure that we can return
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
-    }
-    std::vector<std::pair<double,int>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
-} 
-
-std::vector<std::pair<double, int>> HyperCube::approximate_range_search(std::shared_ptr<ImageVector> image, double r){
-    int i, j, prospectImageNumber;
+std::vector<std::pair<double, int>> HyperCube::k_nearest_rows(const StoreQuery& query, int numberOfNearest){
+    int i, j, row;
     double distance;
     int visitedPointsCounter = 0;
-    int queryImageNumber = image->get_number();
+
+    std::pair<int,int> imageBucketIdAndId;
 
     // This will be saving all the bucket_ids/hypercube vertices that we will be visiting
     std::vector<int> probes;
-    std::vector<std::shared_ptr<ImageVector>> bucket;
-
-    // I will be using a priority queue to keep the k nearest neighbors
-    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::less<std::pair<double, int>>> nearest;
 
     // Let b ← Null; db ← ∞; initialize k best candidates and distances;
-    std::vector<std::pair<double, int>> nearestImages;
+    TopK nearest(numberOfNearest);
 
-    // Get the bucket id
-    int bucketId = Table->get_bucket_id_from_image_vector(image);
+    // The rows of each bucket
+    BucketRows bucket;
 
-    // Get all the (this->Probes)# of probes of a (this->K)-dimensional hypercube
-    probes = get_probes(bucketId, this->MaxHammingDistance, this->K);
+    // Get the bucket id and the image id
+    imageBucketIdAndId = Table->virtual_insert(query.data());
 
-    // For each probe / i.e. for each neighboring vertex of the hypercube within #probe steps
-   i = 0; 
-   while(i < this->Probes && i < (int)(probes.size())){
+    // Get all the vertices within the max hamming distance, the first (this->Probes)# of them are the ones we visit
+    probes = get_probes(imageBucketIdAndId.first, this->MaxHammingDistance, this->K);
+
+     // For each probe / i.e. for each neighboring vertex of the hypercube within #probe steps
+    i = 0; 
+    while(i < this->Probes && i < (int)(probes.size())){
         // Get the bucket
         bucket = (this->Table)->get_bucket_from_bucket_id(probes[i]);  
 
         // Search the bucket for the nearest neighbors
-        //for(j = 0; j < (int)(bucket.size()); j++){
         j = 0;
-        while(j < (int)(bucket.size()) && visitedPointsCounter < (this->M)){
+        while(j < bucket.size() && visitedPointsCounter < (this->M)){
             visitedPointsCounter++;
-
-            prospectImageNumber = bucket[j]->get_number();
-
+            row = bucket[j];
             // Ignore comparing with itself
-            if(prospectImageNumber != queryImageNumber){
-                // dist(p,q)
-                distance = Hmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
+            if(Store->get_number(row) != query.Number){
+                // dist(p,q), given up on as soon as it is certainly farther than the k-th best
+                distance = Store->bounded_comparison_distance(query, row, Kernels, nearest.bound());
 
-                if(distance <= r){
-                    nearest.push(std::make_pair(distance, prospectImageNumber));
-                }
+                // if dist(q, p) < db = k-th best distance then b ← p; db ← dist(q, p)
+                nearest.push(distance, row);
             }
             j++;
         }
         i++;
     }
-    // Fill up the a structure that we can return
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
-    }
-    std::vector<std::pair<double,int>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
+    return nearest.to_distance_pairs(Hmetric);
 }
 
-std::vector<std::pair<double, std::shared_ptr<ImageVector>>> HyperCube::approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r){
-    int i, j;
+std::vector<std::pair<double, int>> HyperCube::range_rows(const StoreQuery& query, double r){
+    int i, j, row;
     double distance;
+    double comparisonRadius = Hmetric->to_comparison_distance(r); // Compare against the radius in the same units as the candidates
     int visitedPointsCounter = 0;
 
     std::pair<int, int> imageBucketIdAndId;
@@ -261,106 +230,87 @@ std::vector<std::pair<double, std::shared_ptr<ImageVector>>> HyperCube::approxim
     std::vector<int> probes;
 
     // The returned vector
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> inRangeImages;
+    std::vector<std::pair<double, int>> inRangeRows;
 
-    // The pointer of each bucket
-    std::vector<std::shared_ptr<ImageVector>> bucket;
+    // The rows of each bucket
+    BucketRows bucket;
 
     // Get the bucket id and the image id
-    imageBucketIdAndId = Table->virtual_insert(image);
-    // printf("Virtual Insert: BucketId: %d, ImageId: %d\n", imageBucketIdAndId.first, imageBucketIdAndId.second);
+    imageBucketIdAndId = Table->virtual_insert(query.data());
 
-    // Get all the (this->Probes)# of probes of a (this->K)-dimensional hypercube
-    probes = get_probes(imageBucketIdAndId.first, this->Probes, this->K);
+    // Get all the vertices within the max hamming distance, the first (this->Probes)# of them are the ones we visit
+    probes = get_probes(imageBucketIdAndId.first, this->MaxHammingDistance, this->K);
 
     // For each probe / i.e. for each neighboring vertex of the hypercube within #probe steps
     i = 0; 
     while(i < this->Probes && i < (int)(probes.size())){
-
-        // printf("Probe: %d\n", probes[i]);
-
         // Get the bucket
         bucket = (this->Table)->get_bucket_from_bucket_id(probes[i]);  
 
         // Search the bucket for the nearest neighbors
         j = 0;
-        while(j < (int)(bucket.size()) && visitedPointsCounter < (this->M)){
+        while(j < bucket.size() && visitedPointsCounter < (this->M)){
             visitedPointsCounter++;
+            row = bucket[j];
             // Ignore comparing with itself
-            if(image != bucket[j]){
-
+            if(Store->get_number(row) != query.Number){
                 // dist(p,q)
-                distance = Hmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
+                distance = Store->bounded_comparison_distance(query, row, Kernels, comparisonRadius);
 
-                if(distance <= r){
-                    inRangeImages.push_back(std::make_pair(distance, bucket[j]));
+                if(distance <= comparisonRadius){
+                    inRangeRows.push_back(std::make_pair(Hmetric->to_distance(distance), row));
                 }
             }
             j++;
         }
         i++;
     }
-    return inRangeImages;
+    return inRangeRows;
 }
 
-std::vector<std::pair<double, std::shared_ptr<ImageVector>>> HyperCube::approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest){
-    int i, j;
-    double distance;
-    int visitedPointsCounter = 0;
-
-    std::pair<int,int> imageBucketIdAndId;
-
-    // This will be saving all the bucket_ids/hypercube vertices that we will be visiting
-    std::vector<int> probes;
-
-    // I will be using a priority queue to keep the k nearest neighbors
-    std::priority_queue<std::pair<double, std::shared_ptr<ImageVector>>, std::vector<std::pair<double, std::shared_ptr<ImageVector>>>, std::less<std::pair<double, std::shared_ptr<ImageVector>>>> nearest;
-
-    // Let b ← Null; db ← ∞; initialize k best candidates and distances;
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
+std::vector<std::pair<double, int>> HyperCube::approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest){
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> nearest = k_nearest_rows(query, numberOfNearest);
 
-    // The pointer of each bucket
-    std::vector<std::shared_ptr<ImageVector>> bucket;
+    for(auto& pair : nearest){
+        pair.second = Store->get_number(pair.second);
+    }
+    return nearest;
+} 
 
-    // Get the bucket id and the image id
-    imageBucketIdAndId = Table->virtual_insert(image);
+std::vector<std::pair<double, int>> HyperCube::approximate_range_search(std::shared_ptr<ImageVector> image, double r){
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> inRange = range_rows(query, r);
 
-    // Get all the (this->Probes)# of probes of a (this->K)-dimensional hypercube
-    probes = get_probes(imageBucketIdAndId.first, this->Probes, this->K);
+    std::sort(inRange.begin(), inRange.end()); // This one has always been returned sorted
+    for(auto& pair : inRange){
+        pair.second = Store->get_number(pair.second);
+    }
+    return inRange;
+}
 
-     // For each probe / i.e. for each neighboring vertex of the hypercube within #probe steps
-    i = 0; 
-    while(i < this->Probes && i < (int)(probes.size())){
-        // Get the bucket
-        bucket = (this->Table)->get_bucket_from_bucket_id(probes[i]);  
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> HyperCube::approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r){
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> inRange = range_rows(query, r);
 
-        // Search the bucket for the nearest neighbors
-        j = 0;
-        while(j < (int)(bucket.size()) && visitedPointsCounter < (this->M)){
-            visitedPointsCounter++;
-            // Ignore comparing with itself
-            if(image != bucket[j]){
-                // dist(p,q)
-                distance = Hmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> inRangeImages;
+    for(auto& pair : inRange){
+        inRangeImages.push_back(std::make_pair(pair.first, Store->get_image(pair.second)));
+    }
+    return inRangeImages;
+}
 
-                // if dist(q, p) < db = k-th best distance then b ← p; db ← dist(q, p), implemented with a priority queue
-                nearest.push(std::make_pair(distance, bucket[j]));    
+std::vector<std::pair<double, std::shared_ptr<ImageVector>>> HyperCube::approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest){
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> nearest = k_nearest_rows(query, numberOfNearest);
 
-                if ((int)(nearest.size()) > numberOfNearest){
-                    nearest.pop(); // Remove the largest image if we are out of space
-                }
-            }
-            j++;
-        }
-        i++;
-    }
-    // Fill up the a structure that we can return
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
+    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
+    for(auto& pair : nearest){
+        nearestImages.push_back(std::make_pair(pair.first, Store->get_image(pair.second)));
     }
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
-
+    return nearestImages;
 }
 
+std::vector<std::pair<double, int>> HyperCube::approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest){
+    return k_nearest_rows(Store->make_query_from_row(row), numberOfNearest);
+}
@@ -18,26 +18,36 @@ std::vector<int> get_probes(int number, int numberOfProbes, int dimensions);
 class HypercubeHashFunction : public HashFunction{
     int K; // d' i.e. the dimension of the hypercube on which the points will be projected to
     std::vector<std::shared_ptr<fFunction>> F; // The f functions
-    std::vector<std::shared_ptr<hFunction>> H; // The h functions
+    std::shared_ptr<ProjectionMatrix> H; // The h functions
 
     public:
-    HypercubeHashFunction(int k, double window, int dimensions);
-    int evaluate_point(std::vector<double> p) override;
+    HypercubeHashFunction(int k, double window, int dimensions, ProjectionType type = PROJECTION_GAUSSIAN);
+    int evaluate_point(const float* p) override;
+    int combine(const int* h); // The vertex out of the values of the K h functions, for when they were evaluated all together
+    std::shared_ptr<ProjectionMatrix> get_projections();
 };
 
 class HyperCube : public ApproximateMethods{
+    bool DataLoaded = false;
     int K, Probes, M, MaxHammingDistance, DataDimensions;
     double W;
     std::shared_ptr<HashTable> Table;
+    std::shared_ptr<HypercubeHashFunction> Hash; // The one the table uses
+    std::shared_ptr<DatasetStore> Store; // The table holds row ids into it
     Metric* Hmetric; // Raw pointer cause it doesn't matter
-    
+    SearchKernels Kernels; // The distances for the store, picked in load_data
+
+    std::vector<std::pair<double, int>> k_nearest_rows(const StoreQuery& query, int numberOfNearest); // <distance, row> pairs
+    std::vector<std::pair<double, int>> range_rows(const StoreQuery& query, double r);
 
     public:
-    HyperCube(int dimensions, int probes, int numberOfElementsToCheck, double window, Metric* metric, int dataDimensions);
+    HyperCube(int dimensions, int probes, int numberOfElementsToCheck, double window, Metric* metric, int dataDimensions, ProjectionType type = PROJECTION_GAUSSIAN);
     void load_data(std::vector<std::shared_ptr<ImageVector>> images) override;
+    void load_data(std::shared_ptr<DatasetStore> store) override;
     std::vector<std::pair<double, int>> approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest) override;
     std::vector<std::pair<double, int>> approximate_range_search(std::shared_ptr<ImageVector> image, double r) override;
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r) override;
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest) override;
+    std::vector<std::pair<double, int>> approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest) override;
 };
 #endif
\ No newline at end of file
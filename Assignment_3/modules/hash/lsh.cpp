@@ -1,7 +1,8 @@
 #include "lsh.h"
+#include "thread_pool.h"
 
 
-LSH::LSH(int l, int k, double window, int tableSize, Metric* metric, int dimensions){
+LSH::LSH(int l, int k, double window, int tableSize, Metric* metric, int dimensions, ProjectionType type){
     this->L = l;
     this->K = k;
     this->W = window;
@@ -10,13 +11,98 @@ LSH::LSH(int l, int k, double window, int tableSize, Metric* metric, int dimensi
 
     Tables.reserve(L);
 
+    this->Projections = std::make_shared<ProjectionMatrix>(this->L * this->K, this->W, this->DataDimensions, type);
     for (int i = 0; i < L; i++){
-        std::shared_ptr<HashFunction> hashFunction = std::make_shared<gFunction>(this->K, this->W, this->DataDimensions);
+        std::shared_ptr<gFunction> hashFunction = std::make_shared<gFunction>(this->K, this->Projections, i * this->K);
+        G.push_back(hashFunction);
         Tables.push_back(std::make_shared<HashTable>(tableSize, hashFunction));
     }
 }
 
+void LSH::table_ids(const float* p, QueryContext& context){
+    context.H.resize(this->L * this->K); // Both only allocate the first time
+    context.Ids.resize(this->L);
+    this->Projections->evaluate_point(p, context.H.data(), context.Projection);
+    for(int i = 0; i < this->L; i++){
+        context.Ids[i] = G[i]->combine(context.H.data() + i * this->K);
+    }
+}
+
+void LSH::set_probes(int probes){
+    this->Probes = std::max(probes, 0);
+}
+
+void LSH::set_max_candidates(int maxCandidates){
+    this->MaxCandidates = std::max(maxCandidates, 1);
+}
+
+void LSH::probe_ids(int table, QueryContext& context){
+    int i, j, coordinate, numberOfPerturbations;
+    uint64_t used;
+    double position;
+    const int* h = context.H.data() + table * this->K;
+
+    context.Probes.clear();
+    context.Probes.push_back(context.Ids[table]);
+    if(this->Probes == 0) return;
+
+    // Every h_i of the table can move one slot down or up, and the closer the query is to that edge of the slot the likelier
+    // it is that a neighbor fell on the other side of it. The score is the squared distance to the edge, in windows
+    context.Perturbations.clear();
+    for(i = 0; i < this->K; i++){
+        position = Projections->slot_position(context.Projection.Products[table * this->K + i], table * this->K + i);
+        context.Perturbations.push_back(std::make_pair(position * position, 2 * i));
+        context.Perturbations.push_back(std::make_pair((1.0 - position) * (1.0 - position), 2 * i + 1));
+    }
+    std::sort(context.Perturbations.begin(), context.Perturbations.end());
+    numberOfPerturbations = std::min((int)context.Perturbations.size(), LSH_MAX_PERTURBATIONS);
+
+    // The sets of changes come out of the heap in increasing score. Every set A gives two bigger ones, A with its largest
+    // member replaced by the next one (shift) and A with the next one added (expand), and that way every set is reached once
+    PerturbationSet set, next;
+    context.Heap.clear();
+    context.Heap.push_back(PerturbationSet{context.Perturbations[0].first, 1, 0});
+    while((int)context.Probes.size() <= this->Probes && !context.Heap.empty()){
+        std::pop_heap(context.Heap.begin(), context.Heap.end());
+        set = context.Heap.back();
+        context.Heap.pop_back();
+
+        if(set.Last + 1 < numberOfPerturbations){
+            next.Last = set.Last + 1;
+            next.Score = set.Score - context.Perturbations[set.Last].first + context.Perturbations[next.Last].first;
+            next.Members = (set.Members & ~(1ULL << set.Last)) | (1ULL << next.Last);
+            context.Heap.push_back(next);
+            std::push_heap(context.Heap.begin(), context.Heap.end());
+
+            next.Score = set.Score + context.Perturbations[next.Last].first;
+            next.Members = set.Members | (1ULL << next.Last);
+            context.Heap.push_back(next);
+            std::push_heap(context.Heap.begin(), context.Heap.end());
+        }
+
+        // The changed h values, unless the set moves some h both up and down
+        context.Perturbed.assign(h, h + this->K);
+        used = 0;
+        for(j = 0; j <= set.Last; j++){
+            if(!(set.Members & (1ULL << j))) continue;
+            coordinate = context.Perturbations[j].second / 2;
+            if(used & (1ULL << coordinate)) break;
+            used |= 1ULL << coordinate;
+            context.Perturbed[coordinate] += (context.Perturbations[j].second & 1) ? 1 : -1;
+        }
+        if(j <= set.Last) continue;
+        context.Probes.push_back(G[table]->combine(context.Perturbed.data()));
+    }
+}
+
 void LSH::load_data(std::vector<std::shared_ptr<ImageVector>> images){ // Load the data to the LSH
+    if(this->DataLoaded){
+        return;
+    }
+    load_data(std::make_shared<DatasetStore>(images));
+}
+
+void LSH::load_data(std::shared_ptr<DatasetStore> store){
     // printf("Loading data to LSH... \n");
     // fflush(stdout);
     if(this->DataLoaded){
@@ -24,114 +110,156 @@ void LSH::load_data(std::vector<std::shared_ptr<ImageVector>> images){ // Load t
         // fflush(stdout);
         return;
     }
+    this->Store = store;
+    this->Kernels = store->search_kernels(this->Lmetric);
     printf("Initializing LSH tables... ");
     fflush(stdout);
-    // int c = 0;
-    for (int i = 0; i < (int)(images.size()); i++){
-        for (int j = 0; j < this->L; j++){
-            (this->Tables)[j]->insert(images[i]);
+    int numberOfRows = Store->size();
+    int numberOfTasks = (numberOfRows + HASH_BUILD_ROWS_PER_TASK - 1) / HASH_BUILD_ROWS_PER_TASK;
+    std::vector<int> ids((size_t)numberOfRows * this->L); // ids[row * L + i] = g_i(row)
+
+    // The whole dataset against all L*K projections as one blocked matrix multiply, split over the threads
+    search_thread_pool().parallel_for(numberOfTasks, [&](int task){
+        int firstRow = task * HASH_BUILD_ROWS_PER_TASK;
+        int count = std::min(HASH_BUILD_ROWS_PER_TASK, numberOfRows - firstRow);
+        std::vector<int> h((size_t)count * this->L * this->K);
+        this->Projections->evaluate_rows(Store, firstRow, count, h.data());
+        for(int r = 0; r < count; r++){
+            for(int i = 0; i < this->L; i++){
+                ids[(size_t)(firstRow + r) * this->L + i] = G[i]->combine(h.data() + ((size_t)r * this->L + i) * this->K);
+            }
         }
-        // printf("%d\n", c++);
+    });
+
+    // The tables have nothing in common, so each one is filled by its own thread
+    search_thread_pool().parallel_for(this->L, [&](int i){
+        (this->Tables)[i]->reserve(numberOfRows);
+        for (int row = 0; row < numberOfRows; row++){
+            (this->Tables)[i]->insert_id(row, ids[(size_t)row * this->L + i]);
+        }
+        (this->Tables)[i]->freeze(); // Nothing else gets inserted, so every bucket can be one piece of an array
+    });
+    for (int i = 0; i < this->L; i++){
+        this->LargestBucket = std::max(this->LargestBucket, (this->Tables)[i]->largest_bucket());
     }
     this->DataLoaded = true;
     printf("Done\n");
     fflush(stdout);
 }
-std::vector<std::pair<double, int>> LSH::approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest){
-    int i, j, imageNumber;
-    double distance;
 
-    // Ignore itself and every other image it has met before
-    std::vector<int> ignore;
-    std::vector<int>::iterator it; // Initializing the iteration variable
-    ignore.push_back(image->get_number());
+void LSH::gather_rows(const StoreQuery& query, QueryContext& context){
+    int i, j, row, numberOfMatches;
+    std::pair<int,int> imageBucketIdAndId;
 
-    // I will be using a priority queue to keep the k nearest neighbors
-    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::less<std::pair<double, int>>> nearest;
+    // Every row met before is marked with this query's epoch, and that is how we ignore it
+    context.begin(Store->size());
+    if((int)context.Candidates.size() < this->LargestBucket) context.Candidates.resize(this->LargestBucket);
+    // Room for every row of the store once, so that a query with more candidates than the ones before doesn't allocate
+    if(context.Rows.capacity() <= (size_t)Store->size()) context.Rows.reserve(Store->size() + 1); // sort_visited needs one more
+    if((int)context.Distances.size() < Store->size()) context.Distances.resize(Store->size());
+    context.Rows.clear();
 
-    // Let b ← Null; db ← ∞; initialize k best candidates and distances;
-    std::vector<std::pair<double, int>> nearestImages;
+    // g_i(q) of every table, the query is projected once for all of them
+    table_ids(query.data(), context);
 
-    // The pointer of each bucket
-    std::vector<std::shared_ptr<ImageVector>> bucket;
-    
     // for i from 1 to L do
-    for(i = 0; i < this->L; i++){
-        bucket = Tables[i]->get_bucket_from_image_vector(image);
-        // for each item p in bucket gi (q) do
-        for(j = 0; j < (int)(bucket.size()); j++){ 
-            // Get the number of the image
-            imageNumber = bucket[j]->get_number();
-
-            // See if we have encountered it before
-            it = std::find(ignore.begin(), ignore.end(), imageNumber);
-            
-            if((Tables[i]->same_id(image, bucket[j])) && (it == ignore.end())){ // Query trick + ignore the images we have encountered before
-                // Ignore the image if you find it again
-                ignore.push_back(imageNumber);
-
-                // dist(p,q)
-                distance = Lmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
-                
-                // if dist(q, p) < db = k-th best distance then b ← p; db ← dist(q, p), implemented with a priority queue
-                nearest.push(std::make_pair(distance, imageNumber));    
-
-                if ((int)(nearest.size()) > numberOfNearest){
-                    nearest.pop();
-                }  
+    for(i = 0; i < this->L && (int)context.Rows.size() < this->MaxCandidates; i++){
+        probe_ids(i, context);
+        for(int probe : context.Probes){ // The bucket of the query and then its neighbors, if we probe
+            imageBucketIdAndId = Tables[i]->virtual_insert_id(probe);
+
+            // The rows of the bucket, read where they are
+            BucketRows bucket = Tables[i]->get_bucket_from_bucket_id(imageBucketIdAndId.first);
+
+            // Query trick, only the rows with the same id as the query. Their ids sit next to each other, so they are all compared at once
+            numberOfMatches = bucket.positions_with_id(imageBucketIdAndId.second, context.Candidates.data());
+
+            // for each item p in bucket gi (q) do
+            for(j = 0; j < numberOfMatches && (int)context.Rows.size() < this->MaxCandidates; j++){
+                row = bucket[context.Candidates[j]];
+
+                // Ignore itself
+                if(Store->get_number(row) == query.Number) continue;
+
+                if(context.visit(row)){ // Ignore the images we have encountered before
+                    context.Rows.push_back(row);
+                }
             }
         }
     }
-    // Fill up the a structure that we can return
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
+
+    // In the order they are stored, so that the distances walk through the store instead of jumping around it
+    context.sort_visited(context.Rows);
+}
+
+void LSH::k_nearest_rows(const StoreQuery& query, int numberOfNearest, QueryContext& context){
+    int i, numberOfRows;
+
+    // Let b ← Null; db ← ∞; initialize k best candidates and distances;
+    TopK& nearest = context.Nearest;
+    nearest.reset(numberOfNearest);
+
+    gather_rows(query, context);
+
+    // dist(p,q) of every candidate in one pass
+    numberOfRows = (int)context.Rows.size();
+    Store->comparison_distances(query, context.Rows.data(), numberOfRows, Kernels, context.Distances.data());
+
+    // if dist(q, p) < db = k-th best distance then b ← p; db ← dist(q, p)
+    for(i = 0; i < numberOfRows; i++){
+        nearest.push(context.Distances[i], context.Rows[i]);
     }
-    std::vector<std::pair<double,int>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
 }
 
-std::vector<std::pair<double, int>> LSH::approximate_range_search(std::shared_ptr<ImageVector> image, double r){
-    int i, j, imageNumber;
-    double distance;
+std::vector<std::pair<double, int>> LSH::k_nearest_rows(const StoreQuery& query, int numberOfNearest){
+    QueryContext& context = thread_query_context();
+    k_nearest_rows(query, numberOfNearest, context);
+    return context.Nearest.to_distance_pairs(Lmetric);
+}
+
+std::vector<std::pair<double, int>> LSH::range_rows(const StoreQuery& query, double r, int maxRetrieved){
+    int i, numberOfRows;
+    double comparisonRadius = Lmetric->to_comparison_distance(r); // Compare against the radius in the same units as the candidates
 
-    // Ignore itself and every other image it has met before
-    std::vector<int> ignore;
-    std::vector<int>::iterator it; // Initializing the iteration variable
-    ignore.push_back(image->get_number());
+    QueryContext& context = thread_query_context();
+    gather_rows(query, context);
 
     // The returned vector
-    std::vector<std::pair<double, int>> inRangeImages;
+    std::vector<std::pair<double, int>> inRangeRows;
 
-    // The pointer of each bucket
-    std::vector<std::shared_ptr<ImageVector>> bucket;
+    // dist(p,q) of every candidate in one pass
+    numberOfRows = (int)context.Rows.size();
+    Store->comparison_distances(query, context.Rows.data(), numberOfRows, Kernels, context.Distances.data());
 
-    // for i from 1 to L do
-    for(i = 0; i < L; i++){
-        bucket = Tables[i]->get_bucket_from_image_vector(image);
-        // for each item p in bucket gi (q) do
-        for(j = 0; j < (int)bucket.size(); j++){
-            // Get the number of the image
-            imageNumber = bucket[j]->get_number();
-
-            // See if we have encountered it before
-            it = std::find(ignore.begin(), ignore.end(), imageNumber);
-
-            if((Tables[i]->same_id(image, bucket[j])) && (it == ignore.end())){ // Query trick + ignore the images we have encountered before
-                // Ignore the image if you find it again
-                ignore.push_back(imageNumber);
-
-                // if dist(q, p) < r then output p
-                distance = Lmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
-                if(distance < r){
-                    inRangeImages.push_back(std::make_pair(distance, imageNumber)); // maybe add bucket[j] also
-                }
-            }
-            // if large number of retrieved items (e.g. > 20L) then return
-            if((int)inRangeImages.size() > 20*(this->L)) return inRangeImages;
+    for(i = 0; i < numberOfRows; i++){
+        // if dist(q, p) < r then output p
+        if(context.Distances[i] <= comparisonRadius){
+            inRangeRows.push_back(std::make_pair(Lmetric->to_distance(context.Distances[i]), context.Rows[i]));
         }
+        // if large number of retrieved items (e.g. > 20L) then return
+        if((int)inRangeRows.size() > maxRetrieved) return inRangeRows;
     }
-    return inRangeImages;
+    return inRangeRows;
+}
+
+std::vector<std::pair<double, int>> LSH::approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest){
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> nearest = k_nearest_rows(query, numberOfNearest);
+
+    for(auto& pair : nearest){
+        pair.second = Store->get_number(pair.second);
+    }
+    return nearest;
+}
+
+std::vector<std::pair<double, int>> LSH::approximate_range_search(std::shared_ptr<ImageVector> image, double r){
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> inRange = range_rows(query, r, 20*(this->L));
+
+    for(auto& pair : inRange){
+        pair.second = Store->get_number(pair.second);
+    }
+    return inRange;
 }
 
 // Turns out I did some assumptions making the LSH/Hypercube programs that weren't so good for the k-means. 
@@ -140,99 +268,27 @@ std::vector<std::pair<double, int>> LSH::approximate_range_search(std::shared_pt
 // This implemntation solves both of these problems; it assumes that the query is not from the dataset and it returns the imagevector type along with the distance
 // Downside of this is that I had to implement some hashtable class methods that are arguably violating encapsulation 
 std::vector<std::pair<double, std::shared_ptr<ImageVector>>> LSH::approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r){ 
-    int i, j;
-    double distance;
-
-    std::pair<int,int> imageBucketIdAndId;
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> inRange = range_rows(query, r, INT_MAX);
 
-    // Ignore itself and every other image it has met before
-    std::vector<std::shared_ptr<ImageVector>> ignore;
-    std::vector<std::shared_ptr<ImageVector>>::iterator it; // Initializing the iteration variable
-    ignore.push_back(image);
-
-    // The returned vector
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> inRangeImages;
-
-    // The pointer of each bucket
-    std::vector<std::shared_ptr<ImageVector>> bucket;
-
-    // for i from 1 to L do
-    for(i = 0; i < L; i++){
-        imageBucketIdAndId = Tables[i]->virtual_insert(image);
-        bucket = Tables[i]->get_bucket_from_bucket_id(imageBucketIdAndId.first);
-        // for each item p in bucket gi (q) do
-        for(j = 0; j < (int)bucket.size(); j++){ // For each image in the bucket
-
-            // See if we have encountered it before
-            it = std::find(ignore.begin(), ignore.end(), bucket[j]);
-
-            if(Tables[i]->get_image_id(bucket[j]) == imageBucketIdAndId.second && (it == ignore.end())){ // Query trick + ignore the images we have encountered before
-                // Ignore the image if you find it again
-                ignore.push_back(bucket[j]);
-
-                // if dist(q, p) < r then output p
-                distance = Lmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
-                if(distance <= r){
-                    inRangeImages.push_back(std::make_pair(distance, bucket[j])); // maybe add bucket[j] also
-                }
-            }
-        }
+    for(auto& pair : inRange){
+        inRangeImages.push_back(std::make_pair(pair.first, Store->get_image(pair.second)));
     }
     return inRangeImages;
 }
 
 std::vector<std::pair<double, std::shared_ptr<ImageVector>>> LSH::approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest){
-    int i, j;
-    double distance;
-
-    std::pair<int,int> imageBucketIdAndId;
-
-    // Ignore itself and every other image it has met before
-    std::vector<std::shared_ptr<ImageVector>> ignore;
-    std::vector<std::shared_ptr<ImageVector>>::iterator it; // Initializing the iteration variable
-    ignore.push_back(image);
-
-    // I will be using a priority queue to keep the k nearest neighbors
-    std::priority_queue<std::pair<double, std::shared_ptr<ImageVector>>, std::vector<std::pair<double, std::shared_ptr<ImageVector>>>, std::less<std::pair<double, std::shared_ptr<ImageVector>>>> nearest;
+    StoreQuery query = Store->make_query(image);
+    std::vector<std::pair<double, int>> nearest = k_nearest_rows(query, numberOfNearest);
 
-    // Let b ← Null; db ← ∞; initialize k best candidates and distances;
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestImages;
-
-    // The pointer of each bucket
-    std::vector<std::shared_ptr<ImageVector>> bucket;
-    
-    // for i from 1 to L do
-    for(i = 0; i < this->L; i++){
-        imageBucketIdAndId = Tables[i]->virtual_insert(image);
-
-        bucket = Tables[i]->get_bucket_from_bucket_id(imageBucketIdAndId.first);
-        // for each image in the bucket 
-        for(j = 0; j < (int)(bucket.size()); j++){ 
-
-            // See if we have encountered the image before before
-            it = std::find(ignore.begin(), ignore.end(), bucket[j]);
-            
-            if(Tables[i]->get_image_id(bucket[j]) == imageBucketIdAndId.second && (it == ignore.end())){ // Query trick + ignore the images we have encountered before
-                // Ignore the image if you find it again
-                ignore.push_back(bucket[j]);
-
-                // dist(p,q)
-                distance = Lmetric->calculate_distance(image->get_coordinates(), bucket[j]->get_coordinates());
-                
-                // if dist(q, p) < db = k-th best distance then b ← p; db ← dist(q, p), implemented with a priority queue
-                nearest.push(std::make_pair(distance, bucket[j]));    
-
-                if ((int)(nearest.size()) > numberOfNearest){
-                    nearest.pop(); // Remove the largest image if we are out of space
-                }  
-            }
-        }
+    for(auto& pair : nearest){
+        nearestImages.push_back(std::make_pair(pair.first, Store->get_image(pair.second)));
     }
-    // Fill up the a structure that we can return
-    while (!nearest.empty()){
-        nearestImages.push_back(nearest.top());
-        nearest.pop();
-    }
-    std::vector<std::pair<double, std::shared_ptr<ImageVector>>> reversed(nearestImages.rbegin(), nearestImages.rend()); // Our vector is in reverse order so we need to reverse it
-    return reversed;
-}
\ No newline at end of file
+    return nearestImages;
+}
+
+std::vector<std::pair<double, int>> LSH::approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest){
+    return k_nearest_rows(Store->make_query_from_row(row), numberOfNearest);
+}
@@ -2,23 +2,55 @@
 #define LSH_H
 
 #include "hashtable.h"
+#include "query_context.h"
 #include "approximate_methods.h"
 
+#define LSH_DEFAULT_PROBES 0 // Only the bucket of the query, like the notes
+#define LSH_DEFAULT_MAX_CANDIDATES INT_MAX // No limit, every row in the buckets of the query gets scored
+#define LSH_MAX_PERTURBATIONS 64 // Only the most promising this many slot changes of a table are combined into probes, they are bits of a uint64_t
+
 class LSH : public ApproximateMethods{
     bool DataLoaded = false;
     int K, L, DataDimensions; 
     double W = WINDOW;
     int M = MODULO;
     std::vector<std::shared_ptr<HashTable>> Tables;
+    int Probes = LSH_DEFAULT_PROBES; // Buckets visited in every table besides the one of the query
+    int MaxCandidates = LSH_DEFAULT_MAX_CANDIDATES; // Rows a query gathers before it stops looking into buckets
+    int LargestBucket = 0; // Of all the tables, so that a query can size its buffers once
+    std::shared_ptr<ProjectionMatrix> Projections; // The h functions of every table, L*K rows, table i uses rows i*K to i*K + K - 1
+    std::vector<std::shared_ptr<gFunction>> G;
+    std::shared_ptr<DatasetStore> Store; // The tables hold row ids into it
     Metric* Lmetric; // Raw pointer cause it doesn't matter
+    SearchKernels Kernels; // The distances for the store, picked in load_data
+
+    void table_ids(const float* p, QueryContext& context); // The id of p in every table into context.Ids, out of one pass of all the projections
+    void probe_ids(int table, QueryContext& context); // The ids of the buckets to visit in a table into context.Probes, after table_ids
+    // The first phase of a query, the rows of its buckets that pass the query trick into context.Rows, each once and sorted.
+    // The distances are computed afterwards in one pass over them (DatasetStore::comparison_distances), so they are read
+    // in memory order instead of bucket after bucket of different tables
+    void gather_rows(const StoreQuery& query, QueryContext& context);
+    std::vector<std::pair<double, int>> k_nearest_rows(const StoreQuery& query, int numberOfNearest); // <distance, row> pairs
+    std::vector<std::pair<double, int>> range_rows(const StoreQuery& query, double r, int maxRetrieved);
 
     public:
-    LSH(int l, int k, double window, int tableSize, Metric* metric, int dataDimensions);
+    LSH(int l, int k, double window, int tableSize, Metric* metric, int dataDimensions, ProjectionType type = PROJECTION_GAUSSIAN);
+    // Multi-probe: also visit the probes buckets of every table that the query most likely missed its neighbors by, the ones
+    // where the h values it is closest to the edge of their slot move over to the next slot (Lv et al.). A few tables with
+    // some probes find about as much as many tables without, and every table is another copy of the dataset's rows
+    void set_probes(int probes);
+    void set_max_candidates(int maxCandidates); // How many rows a query may score at most, the size of context.Rows after it
     void load_data(std::vector<std::shared_ptr<ImageVector>> images) override;
+    void load_data(std::shared_ptr<DatasetStore> store) override;
     std::vector<std::pair<double, int>> approximate_k_nearest_neighbors(std::shared_ptr<ImageVector> image, int numberOfNearest) override;
     std::vector<std::pair<double, int>> approximate_range_search(std::shared_ptr<ImageVector> image, double r) override;
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_range_search_return_images(std::shared_ptr<ImageVector> image, double r) override;
     std::vector<std::pair<double, std::shared_ptr<ImageVector>>> approximate_k_nearest_neighbors_return_images(std::shared_ptr<ImageVector> image, int numberOfNearest) override;
+    std::vector<std::pair<double, int>> approximate_k_nearest_neighbors_of_row(int row, int numberOfNearest) override;
+
+    // The k nearest rows of the query into context.Nearest, with comparison distances. Allocates nothing once the context
+    // has been used on this index, the methods above call it with the context of their thread
+    void k_nearest_rows(const StoreQuery& query, int numberOfNearest, QueryContext& context);
 };
 
 #endif
\ No newline at end of file
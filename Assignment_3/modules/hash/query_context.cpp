@@ -0,0 +1,42 @@
+#include "query_context.h"
+
+#include <algorithm>
+
+QueryContext::QueryContext(){
+    this->Epoch = 0;
+}
+
+void QueryContext::begin(int numberOfRows){
+    if((int)this->Visited.size() < numberOfRows){
+        this->Visited.resize(numberOfRows, 0); // The new rows are 0, never the epoch of a query
+    }
+    this->Epoch++;
+    if(this->Epoch == 0){ // Once every 4 billion queries, the old marks could look like this query's
+        std::fill(this->Visited.begin(), this->Visited.end(), 0);
+        this->Epoch = 1;
+    }
+}
+
+void QueryContext::sort_visited(std::vector<int>& rows){
+    int row, count = 0;
+    int numberOfRows = (int)this->Visited.size();
+
+    if((int)rows.size() * QUERY_SORT_RATIO < numberOfRows){
+        std::sort(rows.begin(), rows.end());
+        return;
+    }
+    // Thousands of rows take longer to sort than a look at every mark, and the marks are already in row order. Every row
+    // is written and only the visited ones are kept, so there is no branch to mispredict. The last write can land one
+    // past them, hence the extra room
+    rows.push_back(0);
+    for(row = 0; row < numberOfRows; row++){
+        rows[count] = row;
+        count += (this->Visited[row] == this->Epoch);
+    }
+    rows.pop_back();
+}
+
+QueryContext& thread_query_context(){
+    static thread_local QueryContext context;
+    return context;
+}
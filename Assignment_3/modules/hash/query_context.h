@@ -0,0 +1,57 @@
+#ifndef QUERY_CONTEXT_H
+#define QUERY_CONTEXT_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "hashtable.h"
+#include "top_k.h"
+
+#define QUERY_SORT_RATIO 32 // sort_visited sorts lists shorter than 1/32 of the rows, it reads the visited marks for the longer ones
+
+// Some of the h values of a query moved one slot up or down, a bucket next to the one of the query (see LSH::probe_ids).
+// Members are positions in QueryContext::Perturbations, the changes sorted by how promising they are
+class PerturbationSet{
+    public:
+    double Score; // The sum of the squared distances to the slot boundaries that get crossed, smaller is more promising
+    uint64_t Members;
+    int Last; // The largest member
+
+    bool operator<(const PerturbationSet& other) const { return this->Score > other.Score; } // So that the std heaps give the smallest first
+};
+
+// Everything a hash table query needs besides the index, kept from one query to the next. Once the buffers have grown
+// to the size of the index a query allocates nothing. A context must not be shared between threads, the searches use
+// the one of the thread they run on (thread_query_context)
+class QueryContext{
+    std::vector<uint32_t> Visited; // Row -> the last query that met it, a new query only has to move to the next epoch
+    uint32_t Epoch;
+
+    public:
+    std::vector<int> H; // The h functions of the query
+    std::vector<int> Ids; // Its id in every table
+    ProjectionScratch Projection;
+    std::vector<int> Candidates; // Positions in a bucket
+    std::vector<int> Rows; // The rows a query gathered from all the tables, each once
+    std::vector<double> Distances; // Distances[i] is the one of Rows[i]
+    std::vector<int> Probes; // The ids of the buckets to visit in a table, the query's own first
+    std::vector<std::pair<double, int>> Perturbations; // <score, 2 * i + 1 if h_i moves up, 2 * i if down> for the h_i of a table
+    std::vector<PerturbationSet> Heap;
+    std::vector<int> Perturbed; // The h values of a probe
+    TopK Nearest;
+
+    QueryContext();
+    void begin(int numberOfRows); // Before every query, numberOfRows is the size of the store of the index
+    bool visit(int row); // True only the first time the current query meets the row
+    void sort_visited(std::vector<int>& rows); // rows are exactly the ones the current query visited, puts them in increasing order
+};
+
+QueryContext& thread_query_context();
+
+inline bool QueryContext::visit(int row){
+    if(this->Visited[row] == this->Epoch) return false;
+    this->Visited[row] = this->Epoch;
+    return true;
+}
+
+#endif
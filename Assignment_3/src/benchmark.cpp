@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <cmath>
+
+#include "distance_kernels.h"
+#include "random_functions.h"
+#include "hashtable.h"
+
+// Times the distance kernels on the sizes we actually use: 784 for the MNIST images and 20 for the encoded ones.
+// Every kernel computes the distance of one query to every point of a small dataset, over and over
+
+#define BENCHMARK_POINTS 4096 // Small enough to stay in cache, we are measuring the arithmetic
+#define BENCHMARK_COORDINATES 20000000 // Roughly the same amount of work for every dimension
+#define BENCHMARK_PROJECTIONS 24 // L*K of the LSH in comparisons
+#define BENCHMARK_HASHES 200000
+
+volatile double Sink; // So that the compiler can't throw the loops away
+
+// The loop that Eucledean::calculate_distance used to run
+double squared_l2_reference(const double* p1, const double* p2, int size){
+    double sum = 0.0;
+    for(int i = 0; i < size; i++){
+        sum += std::pow(p1[i] - p2[i], 2);
+    }
+    return sum;
+}
+
+template <typename T, typename Kernel>
+double time_kernel(Kernel kernel, const std::vector<T>& points, const std::vector<T>& query, int dimensions, int passes){
+    double sum = 0.0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int pass = 0; pass < passes; pass++){
+        for(int point = 0; point < BENCHMARK_POINTS; point++){
+            sum += kernel(query.data(), points.data() + (size_t)point * dimensions, dimensions);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    Sink = sum;
+
+    double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return nanoseconds / ((double)passes * BENCHMARK_POINTS);
+}
+
+void benchmark(int dimensions){
+    Random generator;
+    int i;
+    int passes = BENCHMARK_COORDINATES / (BENCHMARK_POINTS * dimensions) + 1;
+
+    std::vector<double> points64((size_t)BENCHMARK_POINTS * dimensions), query64(dimensions);
+    std::vector<float> points32(points64.size()), query32(dimensions);
+    std::vector<unsigned char> points8(points64.size()), query8(dimensions);
+
+    for(i = 0; i < (int)points64.size(); i++){
+        points8[i] = (unsigned char)generator.generate_int_uniform(0, 255);
+        points32[i] = (float)points8[i];
+        points64[i] = (double)points8[i];
+    }
+    for(i = 0; i < dimensions; i++){
+        query8[i] = (unsigned char)generator.generate_int_uniform(0, 255);
+        query32[i] = (float)query8[i];
+        query64[i] = (double)query8[i];
+    }
+
+    printf("Dimensions: %d\n", dimensions);
+
+    double reference = time_kernel<double>(squared_l2_reference, points64, query64, dimensions, passes);
+    printf("    %-22s %8.2f ns\n", "double std::pow loop", reference);
+
+    for(int level = KERNELS_SCALAR; level <= KERNELS_AVX512; level++){
+        SquaredL2F64Kernel kernel = squared_l2_f64_kernel((KernelLevel)level);
+        if(kernel == nullptr) continue;
+        double time = time_kernel<double>(kernel, points64, query64, dimensions, passes);
+        printf("    double %-15s %8.2f ns  x%.1f\n", kernel_level_name((KernelLevel)level), time, reference / time);
+    }
+    for(int level = KERNELS_SCALAR; level <= KERNELS_AVX512; level++){
+        SquaredL2F32Kernel kernel = squared_l2_f32_kernel((KernelLevel)level);
+        if(kernel == nullptr) continue;
+        double time = time_kernel<float>(kernel, points32, query32, dimensions, passes);
+        printf("    float %-16s %8.2f ns  x%.1f\n", kernel_level_name((KernelLevel)level), time, reference / time);
+    }
+    double time = time_kernel<unsigned char>(squared_l2_u8, points8, query8, dimensions, passes);
+    printf("    uint8 %-16s %8.2f ns  x%.1f\n", "dispatched", time, reference / time);
+}
+
+// All the h functions of the LSH on one point, for every family of projections, with the point as dense as MNIST (a fifth of
+// the pixels) and fully dense
+void benchmark_projections(int dimensions){
+    Random generator;
+    const char* names[] = {"gaussian", "achlioptas", "very sparse"};
+    std::vector<std::vector<float>> points(2, std::vector<float>(dimensions, 0.0f));
+    std::vector<int> h(BENCHMARK_PROJECTIONS);
+    double sum = 0.0;
+
+    for(int i = 0; i < dimensions; i++){
+        points[0][i] = (generator.generate_int_uniform(0, 4) == 0) ? (float)generator.generate_int_uniform(1, 255) : 0.0f;
+        points[1][i] = (float)generator.generate_int_uniform(1, 255);
+    }
+
+    printf("Projections: %d x %d\n", BENCHMARK_PROJECTIONS, dimensions);
+    for(int type = PROJECTION_GAUSSIAN; type <= PROJECTION_VERY_SPARSE; type++){
+        ProjectionMatrix projections(BENCHMARK_PROJECTIONS, WINDOW, dimensions, (ProjectionType)type);
+        double times[2];
+        for(int p = 0; p < 2; p++){
+            auto start = std::chrono::high_resolution_clock::now();
+            for(int pass = 0; pass < BENCHMARK_HASHES; pass++){
+                projections.evaluate_point(points[p].data(), h.data());
+                sum += h[pass % BENCHMARK_PROJECTIONS];
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            times[p] = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / BENCHMARK_HASHES;
+        }
+        printf("    %-22s %8.2f ns sparse point %8.2f ns dense point\n", names[type], times[0], times[1]);
+    }
+    Sink = sum;
+}
+
+int main(){
+    printf("Distance kernels picked: %s\n", distance_kernels_instruction_set());
+    benchmark(784);
+    benchmark(20);
+    benchmark_projections(784);
+    return 0;
+}
@@ -4,12 +4,16 @@
 #include <unistd.h>
 
 #include "io_functions.h"
-#include "mrng.h"
+#include "ground_truth.h"
+#include "two_stage_search.h"
+#include "search_cascade.h"
 
 #define DEFAULT_N 10
 #define MRNG_L_FACTOR 0.001
 #define HYPERCUBE_M_FACTOR 0.06
 #define HYPERCUBE_PROBES_FACTOR 0.01
+#define LSH_PROBES 3 // Neighboring buckets per table, with them 2 tables find more than 6 did without
+#define CASCADE_KEEP 100 // Candidates the reduced scan of the cascade hands to the original space
 
 double calculate_average_approximation_factor(std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestNeighbours, std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestNeighboursApprox){
     double sum = 0;
@@ -57,12 +61,13 @@ int main(int argc, char **argv){
     auto reducedExhaustTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
     auto reducedGnnsTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
     auto reducedMrngTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    auto cascadeTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
 
 
     std::string inputFileName, queriesFileName, reducedInputFileName, reducedQueriesFileName;
 
-    if(argc != 6){
-        printf("Error: Argument Number. Example call: ./comparisons <original dataset> <original queryset> <reduced dataset> <reduced queryset> <number of queries>\n");
+    if(argc != 6 && argc != 7){
+        printf("Error: Argument Number. Example call: ./comparisons <original dataset> <original queryset> <reduced dataset> <reduced queryset> <number of queries> [ground truth file]\n");
         return -1;
     }
     inputFileName = argv[1];
@@ -71,27 +76,29 @@ int main(int argc, char **argv){
     reducedQueriesFileName = argv[4];
     int numberOfQueries = atoi(argv[5]);
 
-    // Read the original sets from the file 
-    std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> datasetInfo = read_mnist_images(inputFileName, 0);
-    HeaderInfo* datasetHeaderInfo = datasetInfo.first.get();
-    std::vector<std::shared_ptr<ImageVector>> dataset = datasetInfo.second;
-    if(dataset.empty()){
+    // Map the original dataset and pack it into the store that all the original space methods share
+    MappedImages mappedDataset(inputFileName);
+    if(!mappedDataset.is_open() || mappedDataset.get_number_of_images() == 0){
         printf("Error reading file: %s\n", inputFileName.c_str());
         return -1;
     }
-    if((int)dataset.size() != datasetHeaderInfo->get_numberOfImages()){
-        printf("Warning: Dataset size does not match the header info (%d vs %d)\n", (int)dataset.size(), datasetHeaderInfo->get_numberOfImages());
+    HeaderInfo* datasetHeaderInfo = mappedDataset.get_header_info().get();
+    std::shared_ptr<DatasetStore> dataset = std::make_shared<DatasetStore>(mappedDataset, 0, STORE_UINT8);
+    dataset->order_dimensions_by_variance(); // The border pixels are almost always zero, put them last
+    if(dataset->size() != datasetHeaderInfo->get_numberOfImages()){
+        printf("Warning: Dataset size does not match the header info (%d vs %d)\n", dataset->size(), datasetHeaderInfo->get_numberOfImages());
     }
 
-    std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> querysetInfo = read_mnist_images(queriesFileName, (int)dataset.size());
-    HeaderInfo* querysetHeaderInfo = querysetInfo.first.get();
-    std::vector<std::shared_ptr<ImageVector>> queryset = querysetInfo.second;
-    if(queryset.empty()){
+    // The queries only become images when they are picked, get_image makes them from the rows
+    MappedImages mappedQueryset(queriesFileName);
+    if(!mappedQueryset.is_open() || mappedQueryset.get_number_of_images() == 0){
         printf("Error reading file: %s\n", queriesFileName.c_str());
         return -1;
     }
-    if((int)queryset.size() != querysetHeaderInfo->get_numberOfImages()){
-        printf("Warning: Queryset size does not match the header info (%d vs %d)\n", (int)queryset.size(), querysetHeaderInfo->get_numberOfImages());
+    HeaderInfo* querysetHeaderInfo = mappedQueryset.get_header_info().get();
+    std::shared_ptr<DatasetStore> queryset = std::make_shared<DatasetStore>(mappedQueryset, dataset->size(), STORE_UINT8); // Same numbering as read_mnist_images
+    if(queryset->size() != querysetHeaderInfo->get_numberOfImages()){
+        printf("Warning: Queryset size does not match the header info (%d vs %d)\n", queryset->size(), querysetHeaderInfo->get_numberOfImages());
     }
 
     // Check that the shapes match between the two original sets
@@ -102,27 +109,41 @@ int main(int argc, char **argv){
 
     int originalDimensions = datasetHeaderInfo->get_numberOfRows() * datasetHeaderInfo->get_numberOfColumns();
 
-    // Read the reduced sets from the file 
-    std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> reducedDatasetInfo = read_mnist_images(reducedInputFileName, 0);
-    HeaderInfo* reducedDatasetHeaderInfo = reducedDatasetInfo.first.get();
-    std::vector<std::shared_ptr<ImageVector>> reducedDataset = reducedDatasetInfo.second;
-    if(reducedDataset.empty()){
+    // The true neighbors from ./ground_truth, only if the file was made from these exact sets. Otherwise we find them ourselves
+    std::shared_ptr<GroundTruth> groundTruth;
+    if(argc == 7){
+        groundTruth = std::make_shared<GroundTruth>(argv[6]);
+        if(!groundTruth->matches(file_content_hash(inputFileName), file_content_hash(queriesFileName))){
+            printf("Warning: %s was not made from these files, finding the true neighbors instead\n", argv[6]);
+            groundTruth = nullptr;
+        }
+        else if(groundTruth->get_k() < DEFAULT_N || groundTruth->get_number_of_queries() != queryset->size()){
+            printf("Warning: %s has too few neighbors or the wrong number of queries, finding the true neighbors instead\n", argv[6]);
+            groundTruth = nullptr;
+        }
+    }
+
+    // Same for the reduced sets
+    MappedImages mappedReducedDataset(reducedInputFileName);
+    if(!mappedReducedDataset.is_open() || mappedReducedDataset.get_number_of_images() == 0){
         printf("Error reading file: %s\n", reducedInputFileName.c_str());
         return -1;
     }
-    if((int)reducedDataset.size() != reducedDatasetHeaderInfo->get_numberOfImages()){
-        printf("Warning: Reduced dataset size does not match the header info (%d vs %d)\n", (int)reducedDataset.size(), reducedDatasetHeaderInfo->get_numberOfImages());
+    HeaderInfo* reducedDatasetHeaderInfo = mappedReducedDataset.get_header_info().get();
+    std::shared_ptr<DatasetStore> reducedDataset = std::make_shared<DatasetStore>(mappedReducedDataset, 0, STORE_UINT8);
+    if(reducedDataset->size() != reducedDatasetHeaderInfo->get_numberOfImages()){
+        printf("Warning: Reduced dataset size does not match the header info (%d vs %d)\n", reducedDataset->size(), reducedDatasetHeaderInfo->get_numberOfImages());
     }
 
-    std::pair<std::shared_ptr<HeaderInfo>, std::vector<std::shared_ptr<ImageVector>>> reducedQuerysetInfo = read_mnist_images(reducedQueriesFileName, (int)reducedDataset.size());
-    HeaderInfo* reducedQuerysetHeaderInfo = reducedQuerysetInfo.first.get();
-    std::vector<std::shared_ptr<ImageVector>> reducedQueryset = reducedQuerysetInfo.second;
-    if(reducedQueryset.empty()){
+    MappedImages mappedReducedQueryset(reducedQueriesFileName);
+    if(!mappedReducedQueryset.is_open() || mappedReducedQueryset.get_number_of_images() == 0){
         printf("Error reading file: %s\n", reducedQueriesFileName.c_str());
         return -1;
     }
-    if((int)reducedQueryset.size() != reducedQuerysetHeaderInfo->get_numberOfImages()){
-        printf("Warning: Reduced queryset size does not match the header info (%d vs %d)\n", (int)reducedQueryset.size(), reducedQuerysetHeaderInfo->get_numberOfImages());
+    HeaderInfo* reducedQuerysetHeaderInfo = mappedReducedQueryset.get_header_info().get();
+    std::shared_ptr<DatasetStore> reducedQueryset = std::make_shared<DatasetStore>(mappedReducedQueryset, reducedDataset->size(), STORE_UINT8);
+    if(reducedQueryset->size() != reducedQuerysetHeaderInfo->get_numberOfImages()){
+        printf("Warning: Reduced queryset size does not match the header info (%d vs %d)\n", reducedQueryset->size(), reducedQuerysetHeaderInfo->get_numberOfImages());
     }
 
     // Check that the shapes match between the two reduced sets
@@ -132,17 +153,15 @@ int main(int argc, char **argv){
     }
     int reducedDimensions = reducedDatasetHeaderInfo->get_numberOfRows() * reducedDatasetHeaderInfo->get_numberOfColumns();
     
-    // Set up the correspondances, we can then use the number of the image to get the original coordinates with get_initial
-    SpaceCorrespondace datasetSpaceCorrespondace(dataset);
-
     // Set up the methods for the Original Space
     // LSH
-    std::shared_ptr<LSH> lsh = std::make_shared<LSH>(6, 4, 1400, 7500, &metric, originalDimensions); 
+    std::shared_ptr<LSH> lsh = std::make_shared<LSH>(2, 4, 1400, 7500, &metric, originalDimensions); 
+    lsh->set_probes(LSH_PROBES);
     lsh->load_data(dataset);
 
     // Hypercube
-    int probes = (int)(HYPERCUBE_PROBES_FACTOR * (double)dataset.size());
-    int M = (int)(HYPERCUBE_M_FACTOR * (double)dataset.size());
+    int probes = (int)(HYPERCUBE_PROBES_FACTOR * (double)dataset->size());
+    int M = (int)(HYPERCUBE_M_FACTOR * (double)dataset->size());
     std::shared_ptr<HyperCube> hypercube = std::make_shared<HyperCube>(11, probes, M, WINDOW, &metric, originalDimensions);
     hypercube->load_data(dataset);
 
@@ -157,7 +176,7 @@ int main(int argc, char **argv){
     printf("Original GNNS initialization time: %f\n", gnnsIndexCreationTime);
     
     // MRNG
-    int l = (int)(MRNG_L_FACTOR * (double)dataset.size());
+    int l = (int)(MRNG_L_FACTOR * (double)dataset->size());
     start = std::chrono::high_resolution_clock::now();
     std::shared_ptr<MonotonicRelativeNeighborGraph> mrng = std::make_shared<MonotonicRelativeNeighborGraph>(dataset, lsh, l, &metric);
     end = std::chrono::high_resolution_clock::now();
@@ -188,6 +207,25 @@ int main(int argc, char **argv){
     auto reducedMrngInitializationTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
     double reducedMrngIndexCreationTime = reducedMrngInitializationTime.count() / 1e9;
     printf("Reduced MRNG initialization time: %f\n", reducedMrngIndexCreationTime);
+
+    // The reduced methods answer in the original space, their candidates are ranked again by the true distance.
+    // The reduced images keep the numbers of their original images, so that is how the queries find their reduced twins
+    std::vector<std::shared_ptr<TwoStageSearch>> reducedSearches = {
+        std::make_shared<TwoStageSearch>(reducedDataset, &metric),
+        std::make_shared<TwoStageSearch>(reducedGnns, 3, 10, 20, &metric),
+        std::make_shared<TwoStageSearch>(reducedMrng, l, &metric)
+    };
+    for(auto& reducedSearch : reducedSearches){
+        reducedSearch->add_reduced_queries(reducedQueryset);
+        reducedSearch->load_data(dataset);
+    }
+    std::shared_ptr<TwoStageSearch> reducedExhaust = reducedSearches[0], reducedGnnsSearch = reducedSearches[1], reducedMrngSearch = reducedSearches[2];
+    printf("Reduced candidates per neighbor: %g\n", reducedExhaust->get_alpha());
+
+    // The cascade scans the whole reduced space and only the candidates it keeps get to the original one
+    SearchCascade cascade(&metric);
+    cascade.add_stage(reducedDataset, reducedQueryset, CASCADE_KEEP);
+    cascade.add_stage(dataset, queryset, DEFAULT_N);
     fflush(stdout);
 
     // Search 
@@ -206,6 +244,7 @@ int main(int argc, char **argv){
         double reducedExhaustTimeSum = 0;
         double reducedGnnsTimeSum = 0;
         double reducedMrngTimeSum = 0;
+        double cascadeTimeSum = 0;
 
         // Approximation factors
         double lshAAF = 0;
@@ -215,23 +254,49 @@ int main(int argc, char **argv){
         double reducedExhaustAAF = 0;
         double reducedGnnsAAF= 0;
         double reducedMrngAAF = 0;
+        double cascadeAAF = 0;
 
 
 
+        // Pick the queries first, so that the true neighbors of all of them can be found in one pass over the dataset
+        std::vector<int> randomIndexes;
+        std::vector<StoreQuery> originalQueries;
         for(int i = 0; i < queriesInRow; i++){
-            int randomIndex = rand.generate_int_uniform(0, (int)queryset.size() - 1);
+            randomIndexes.push_back(rand.generate_int_uniform(0, queryset->size() - 1));
+            originalQueries.push_back(dataset->make_query(queryset->get_image(randomIndexes[i])));
+        }
 
-            // Original Space
-            // True
+        // Original Space
+        // True
+        std::vector<std::vector<std::pair<double, int>>> nearestTrueRows;
+        if(groundTruth != nullptr){
+            for(int i = 0; i < queriesInRow; i++){
+                nearestTrueRows.push_back(groundTruth->get_nearest(randomIndexes[i], DEFAULT_N));
+                for(auto& pair : nearestTrueRows.back()){
+                    pair.second = dataset->get_row_of_number(pair.second); // Image numbers to rows
+                }
+            }
+        }
+        else{
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestTrue = exhaustive_nearest_neighbor_search_return_images(dataset, queryset[randomIndex], DEFAULT_N, &metric);
+            nearestTrueRows = exhaustive_nearest_neighbor_search_batch(dataset, originalQueries, DEFAULT_N, &metric);
             end = std::chrono::high_resolution_clock::now();
             trueExhaustTime = end - start;
-            trueExhaustTimeSum += trueExhaustTime.count();
+            trueExhaustTimeSum += trueExhaustTime.count(); // Still reported per query below
+        }
+
+        for(int i = 0; i < queriesInRow; i++){
+            int randomIndex = randomIndexes[i];
+            std::shared_ptr<ImageVector> queryImage = queryset->get_image(randomIndex);
+
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestTrue;
+            for(auto& pair : nearestTrueRows[i]){
+                nearestTrue.push_back(std::make_pair(pair.first, dataset->get_image(pair.second)));
+            }
 
             // LSH
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestLSH = lsh->approximate_k_nearest_neighbors_return_images(queryset[randomIndex], DEFAULT_N);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestLSH = lsh->approximate_k_nearest_neighbors_return_images(queryImage, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
             if(nearestLSH.empty()){
                 printf("Failed approximation: LSH\n");
@@ -244,11 +309,11 @@ int main(int argc, char **argv){
             }
 
             fprintf(outputFile, "Original LSH: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestLSH, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestLSH, nearestTrue, outputFile);
 
             // Hypercube
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestHypercube = hypercube->approximate_k_nearest_neighbors_return_images(queryset[randomIndex], DEFAULT_N);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestHypercube = hypercube->approximate_k_nearest_neighbors_return_images(queryImage, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
             if(nearestHypercube.empty()){
                 printf("Failed approximation: Hypercube\n");
@@ -260,11 +325,11 @@ int main(int argc, char **argv){
                 hypercubeAAF += calculate_average_approximation_factor(nearestTrue, nearestHypercube);
             }
             fprintf(outputFile, "Original Hypercube: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestHypercube, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestHypercube, nearestTrue, outputFile);
 
             // GNNS
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestGnns = gnns->k_nearest_neighbor_search(queryset[randomIndex], 3, 10, 20, DEFAULT_N);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestGnns = gnns->k_nearest_neighbor_search(queryImage, 3, 10, 20, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
             if(nearestGnns.empty()){
                 printf("Failed approximation: GNNS\n");
@@ -276,11 +341,11 @@ int main(int argc, char **argv){
                 gnnsAAF += calculate_average_approximation_factor(nearestTrue, nearestGnns);
             }
             fprintf(outputFile, "Original GNNS: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestGnns, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestGnns, nearestTrue, outputFile);
 
             // MRNG
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestMrng = mrng->k_nearest_neighbor_search(queryset[randomIndex], l, DEFAULT_N);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestMrng = mrng->k_nearest_neighbor_search(queryImage, l, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
             if(nearestMrng.empty()){
                 printf("Failed approximation: MRNG\n");
@@ -292,78 +357,67 @@ int main(int argc, char **argv){
                 mrngAAF += calculate_average_approximation_factor(nearestTrue, nearestMrng);
             }
             fprintf(outputFile, "Original MRNG: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestMrng, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestMrng, nearestTrue, outputFile);
 
 
             // Reduced Space
             // Exhaustive
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedExhaust = exhaustive_nearest_neighbor_search_return_images(reducedDataset, reducedQueryset[randomIndex], DEFAULT_N, &metric);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedExhaustDistanceCorrespondace = reducedExhaust->approximate_k_nearest_neighbors_return_images(queryImage, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
-        
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedExhaustDistanceCorrespondace;
-            for(auto& image : nearestReducedExhaust){
-                nearestReducedExhaustDistanceCorrespondace.push_back({
-                    metric.calculate_distance(datasetSpaceCorrespondace.get_initial(image.second->get_number())->get_coordinates(), queryset[randomIndex]->get_coordinates())
-                    ,
-                    image.second
-                });
-            }
+
             reducedExhaustTime = end - start;
             reducedExhaustTimeSum += reducedExhaustTime.count();
             reducedExhaustAAF += calculate_average_approximation_factor(nearestTrue, nearestReducedExhaustDistanceCorrespondace);
             fprintf(outputFile, "Reduced Exhaustive: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestReducedExhaustDistanceCorrespondace, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestReducedExhaustDistanceCorrespondace, nearestTrue, outputFile);
 
             // Reduced GNNS
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedGnns = reducedGnns->k_nearest_neighbor_search(reducedQueryset[randomIndex], 3, 10, 20, DEFAULT_N);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedGnnsDistanceCorrespondace = reducedGnnsSearch->approximate_k_nearest_neighbors_return_images(queryImage, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
             
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedGnnsDistanceCorrespondace;
-            
-            if(nearestReducedGnns.empty()){
+            if(nearestReducedGnnsDistanceCorrespondace.empty()){
                 printf("Failed approximation: Reduced GNNS\n");
             }
             else{
-                for(auto& image : nearestReducedGnns){
-                    nearestReducedGnnsDistanceCorrespondace.push_back({
-                        metric.calculate_distance(datasetSpaceCorrespondace.get_initial(image.second->get_number())->get_coordinates(), queryset[randomIndex]->get_coordinates())
-                        ,
-                        image.second
-                    });
-                }
                 reducedGnnsTime = end - start;
                 reducedGnnsTimeSum += reducedGnnsTime.count();
                 reducedGnnsAAF += calculate_average_approximation_factor(nearestTrue, nearestReducedGnnsDistanceCorrespondace);
             }
             fprintf(outputFile, "Reduced GNNS: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestReducedGnnsDistanceCorrespondace, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestReducedGnnsDistanceCorrespondace, nearestTrue, outputFile);
 
             // MRNG
             start = std::chrono::high_resolution_clock::now();
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedMrng = reducedMrng->k_nearest_neighbor_search(reducedQueryset[randomIndex], l, DEFAULT_N);
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedMrngDistanceCorrespondace = reducedMrngSearch->approximate_k_nearest_neighbors_return_images(queryImage, DEFAULT_N);
             end = std::chrono::high_resolution_clock::now();
             
-            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestReducedMrngDistanceCorrespondace;
-           
-            if(nearestReducedMrng.empty()){
+            if(nearestReducedMrngDistanceCorrespondace.empty()){
                 printf("Failed approximation: Reduced MRNG\n");
             }
             else{  
-                for(auto& image : nearestReducedMrng){
-                    nearestReducedMrngDistanceCorrespondace.push_back({
-                        metric.calculate_distance(datasetSpaceCorrespondace.get_initial(image.second->get_number())->get_coordinates(), queryset[randomIndex]->get_coordinates())
-                        ,
-                        image.second
-                    });
-                }
                 reducedMrngTime = end - start;
                 reducedMrngTimeSum += reducedMrngTime.count();
                 reducedMrngAAF += calculate_average_approximation_factor(nearestTrue, nearestReducedMrngDistanceCorrespondace);
             }
             fprintf(outputFile, "Reduced MRNG: \n");
-            write_results((int)dataset.size(), queryset[randomIndex], nearestReducedMrngDistanceCorrespondace, nearestTrue, outputFile);
+            write_results(dataset->size(), queryImage, nearestReducedMrngDistanceCorrespondace, nearestTrue, outputFile);
+
+            // Cascade
+            start = std::chrono::high_resolution_clock::now();
+            std::vector<std::pair<double, int>> nearestCascadeNumbers = cascade.k_nearest_neighbors(queryImage->get_number(), DEFAULT_N);
+            end = std::chrono::high_resolution_clock::now();
+
+            std::vector<std::pair<double, std::shared_ptr<ImageVector>>> nearestCascade;
+            for(auto& pair : nearestCascadeNumbers){
+                nearestCascade.push_back(std::make_pair(pair.first, dataset->get_image(dataset->get_row_of_number(pair.second))));
+            }
+            cascadeTime = end - start;
+            cascadeTimeSum += cascadeTime.count();
+            cascadeAAF += calculate_average_approximation_factor(nearestTrue, nearestCascade);
+            fprintf(outputFile, "Cascade: \n");
+            write_results(dataset->size(), queryImage, nearestCascade, nearestTrue, outputFile);
         }
         // Calculate the average times
         double averageTrueExhaustTime = trueExhaustTimeSum / (double)queriesInRow;
@@ -374,6 +428,7 @@ int main(int argc, char **argv){
         double averageReducedExhaustTime = reducedExhaustTimeSum / (double)queriesInRow;
         double averageReducedGnnsTime = reducedGnnsTimeSum / (double)queriesInRow;
         double averageReducedMrngTime = reducedMrngTimeSum / (double)queriesInRow;
+        double averageCascadeTime = cascadeTimeSum / (double)queriesInRow;
 
         // Calculate the average AAF
         double averageLshAAF = lshAAF / (double)queriesInRow;
@@ -383,10 +438,12 @@ int main(int argc, char **argv){
         double averageReducedExhaustAAF = reducedExhaustAAF / (double)queriesInRow;
         double averageReducedGnnsAAF = reducedGnnsAAF / (double)queriesInRow;
         double averageReducedMrngAAF = reducedMrngAAF / (double)queriesInRow;
+        double averageCascadeAAF = cascadeAAF / (double)queriesInRow;
 
         // Print the average times and AAF for each method
         printf("Queries in row: %d\n", queriesInRow);
-        printf("True Exhaustive: %f\n", averageTrueExhaustTime / billion);
+        if(groundTruth != nullptr) printf("True Exhaustive: from the ground truth file\n");
+        else printf("True Exhaustive: %f\n", averageTrueExhaustTime / billion);
         printf("LSH: %f AAF: %f\n", averageLshTime / billion, averageLshAAF);
         printf("Hypercube: %f AAF: %f\n", averageHypercubeTime / billion, averageHypercubeAAF);
         printf("GNNS: %f AAF: %f\n", averageGnnsTime / billion, averageGnnsAAF);
@@ -394,6 +451,7 @@ int main(int argc, char **argv){
         printf("Reduced Exhaustive: %f AAF: %f\n", averageReducedExhaustTime / billion, averageReducedExhaustAAF);
         printf("Reduced GNNS: %f AAF: %f\n", averageReducedGnnsTime / billion, averageReducedGnnsAAF);
         printf("Reduced MRNG: %f AAF: %f\n", averageReducedMrngTime / billion, averageReducedMrngAAF);
+        printf("Cascade: %f AAF: %f\n", averageCascadeTime / billion, averageCascadeAAF);
         printf("\n");
     }
     fclose(outputFile);
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "io_functions.h"
+#include "dataset_store.h"
+#include "ground_truth.h"
+
+// Finds the exact nearest neighbors of every query of a queryset and saves them for the drivers,
+// see ground_truth.h. Example call: ./ground_truth <dataset> <queryset> <output file> [k]
+
+#define DEFAULT_GROUND_TRUTH_K 100
+
+int main(int argc, char **argv){
+    Eucledean metric;
+
+    if(argc != 4 && argc != 5){
+        printf("Error: Argument Number. Example call: ./ground_truth <dataset> <queryset> <output file> [k]\n");
+        return -1;
+    }
+    std::string inputFileName = argv[1];
+    std::string queriesFileName = argv[2];
+    std::string outputFileName = argv[3];
+    int k = (argc == 5) ? atoi(argv[4]) : DEFAULT_GROUND_TRUTH_K;
+    if(k <= 0){
+        printf("Error: k has to be positive\n");
+        return -1;
+    }
+
+    MappedImages mappedDataset(inputFileName);
+    if(!mappedDataset.is_open() || mappedDataset.get_number_of_images() == 0){
+        printf("Error reading file: %s\n", inputFileName.c_str());
+        return -1;
+    }
+    std::shared_ptr<DatasetStore> dataset = std::make_shared<DatasetStore>(mappedDataset, 0, STORE_UINT8);
+    dataset->order_dimensions_by_variance();
+
+    // Same numbering as the drivers, the queries come after the dataset
+    std::vector<std::shared_ptr<ImageVector>> queryset = read_mnist_images(queriesFileName, dataset->size()).second;
+    if(queryset.empty()){
+        printf("Error reading file: %s\n", queriesFileName.c_str());
+        return -1;
+    }
+
+    std::vector<StoreQuery> queries;
+    for(auto& image : queryset){
+        queries.push_back(dataset->make_query(image));
+    }
+
+    printf("Finding the %d nearest of %d queries... ", k, (int)queries.size());
+    fflush(stdout);
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::vector<std::pair<double, int>>> nearest = exhaustive_nearest_neighbor_search_batch(dataset, queries, k, &metric);
+    auto end = std::chrono::high_resolution_clock::now();
+    printf("Done in %f seconds\n", std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1e9);
+
+    for(auto& queryNearest : nearest){
+        for(auto& pair : queryNearest){
+            pair.second = dataset->get_number(pair.second); // Rows to image numbers
+        }
+    }
+
+    if(!write_ground_truth(outputFileName, file_content_hash(inputFileName), file_content_hash(queriesFileName), k, nearest)){
+        return -1;
+    }
+    printf("Saved %s\n", outputFileName.c_str());
+    return 0;
+}